@@ -0,0 +1,342 @@
+#include "autopilot.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+template <class Core>
+const int BasicAutopilot<Core>::defaultBudget = 4096;
+template <class Core>
+const int BasicAutopilot<Core>::blocked = INT_MAX;
+
+// One step along a Hamiltonian cycle of a w x h board, h even and both at
+// least 2: right along the top row, through the other columns in a
+// serpentine down to the bottom row and back up the first column.
+static void cycleStep(int &x, int &y, int w, int h) {
+    if (x == 0 && y > 0)
+        y--;
+    else if (y == 0 || y % 2 == 0)
+        x < w - 1 ? x++ : y++;
+    else
+        x > 1 || y == h - 1 ? x-- : y++;
+}
+
+template <class Core>
+BasicAutopilot<Core>::BasicAutopilot() :
+    width {0},
+    height {0},
+    budget {defaultBudget},
+    left {0},
+    occupiedGen {0},
+    seenGen {0},
+    length {0},
+    growth {0},
+    planBonus {-1, -1},
+    planHead {-1} { }
+
+template <class Core>
+void BasicAutopilot<Core>::setBudget(int cells) {
+    budget = std::max(cells, 1);
+}
+
+template <class Core>
+int BasicAutopilot<Core>::getBudget() const {
+    return budget;
+}
+
+template <class Core>
+void BasicAutopilot<Core>::reset(const Core &core) {
+    width = core.getWidth();
+    height = core.getHeight();
+    scratch.assign(static_cast<size_t>(width) * height, Scratch {0, 0, 0, 0});
+    occupiedGen = 0;
+    seenGen = 0;
+    plan.clear();
+}
+
+// the stamps only wrap after billions of searches, a soak run may get there
+template <class Core>
+void BasicAutopilot<Core>::nextGeneration(std::uint32_t Scratch::*stamp, std::uint32_t &gen) {
+    if (++gen != 0)
+        return;
+    for (auto &s: scratch)
+        s.*stamp = 0;
+    gen = 1;
+}
+
+template <class Core>
+int BasicAutopilot<Core>::freeAt(const Core &core, int cell, const Cell &chunk) const {
+    const Scratch &s = scratch[cell];
+    if (s.occupiedGen == occupiedGen)
+        return s.freeAt;
+    return !core.inBody(chunk) && !core.inBarrier(chunk) ? 0 : blocked;
+}
+
+// free right now, that is on the coming step
+template <class Core>
+bool BasicAutopilot<Core>::isFree(const Core &core, int cell) const {
+    Cell chunk(cell % width, cell / width);
+    return !core.inBody(chunk) && !core.inBarrier(chunk);
+}
+
+template <class Core>
+int BasicAutopilot<Core>::neighbour(int cell, int dir) const {
+    Cell chunk = Cell(cell % width, cell / width).next(static_cast<Direction>(dir));
+    if (chunk.x < 0 || chunk.x >= width || chunk.y < 0 || chunk.y >= height)
+        return -1;
+    return chunk.y * width + chunk.x;
+}
+
+template <class Core>
+Direction BasicAutopilot<Core>::towards(int from, int to) const {
+    return Cell(from % width, from / width).calcDirection(Cell(to % width, to / width));
+}
+
+// the successor on the board's Hamiltonian cycle, or -1 when both sides are
+// odd and there is none
+template <class Core>
+int BasicAutopilot<Core>::cycleNext(int cell) const {
+    int x = cell % width, y = cell / width;
+    if (height % 2 == 0)
+        cycleStep(x, y, width, height);
+    else if (width % 2 == 0)
+        cycleStep(y, x, height, width);
+    else
+        return -1;
+    return y * width + x;
+}
+
+// Stamps when each segment of the tail end moves out of the way: with
+// length L and g steps of growth pending, segment i (0 is the head) frees
+// its cell for a head arriving on step s > L - i + g. Segments further than
+// one budget from the tail cannot clear within a search and stay blocked.
+template <class Core>
+void BasicAutopilot<Core>::loadBody(const Core &core) {
+    length = core.getLength();
+    growth = core.getPendingGrowth();
+
+    nextGeneration(&Scratch::occupiedGen, occupiedGen);
+
+    int count = std::min(length, budget + 1);
+    chain.resize(count);
+    for (int c = 0; c < count; c++) {
+        int i = count - 1 - c;
+        Cell chunk = core.bodyAt(i);
+        int cell = chunk.y * width + chunk.x;
+        chain[c] = cell;
+        scratch[cell].occupiedGen = occupiedGen;
+        scratch[cell].freeAt = length - i + growth;
+    }
+}
+
+// A* from `from` to `to`; a cell is entered on step s only if s > freeAt.
+// The first step never goes to `avoid`, the cell behind the head. Fills
+// path with the cells after `from`, `to` last.
+template <class Core>
+bool BasicAutopilot<Core>::search(const Core &core, int from, int to, int avoid, std::vector<int> &path) {
+    path.clear();
+    if (from == to)
+        return true;
+
+    nextGeneration(&Scratch::seenGen, seenGen);
+
+    // cells travel with their coordinates, the loop below divides nothing
+    Cell target(to % width, to / width);
+    auto distance = [&](const Cell &chunk) {
+        return std::abs(chunk.x - target.x) + std::abs(chunk.y - target.y);
+    };
+
+    open.clear();
+    scratch[from].seenGen = seenGen;
+    scratch[from].steps = 0;
+    Cell start(from % width, from / width);
+    open.push_back(Node {distance(start), 0, from, start});
+
+    while (!open.empty()) {
+        if (left <= 0)
+            return false;
+        left--;
+
+        std::pop_heap(open.begin(), open.end());
+        Node node = open.back();
+        open.pop_back();
+        if (scratch[node.cell].steps != node.steps)
+            continue;
+
+        int steps = node.steps + 1, x = node.at.x, y = node.at.y;
+        int around[4] = {x > 0 ? node.cell - 1 : -1,
+                         x < width - 1 ? node.cell + 1 : -1,
+                         y > 0 ? node.cell - width : -1,
+                         y < height - 1 ? node.cell + width : -1};
+        for (int dir = 0; dir < 4; dir++) {
+            int cell = around[dir];
+            Cell chunk = node.at.next(static_cast<Direction>(dir));
+            if (cell < 0 || (node.steps == 0 && cell == avoid) || steps <= freeAt(core, cell, chunk))
+                continue;
+
+            Scratch &s = scratch[cell];
+            if (s.seenGen == seenGen && s.steps <= steps)
+                continue;
+            s.seenGen = seenGen;
+            s.steps = steps;
+
+            if (cell != to) {
+                open.push_back(Node {steps + distance(chunk), steps, cell, chunk});
+                std::push_heap(open.begin(), open.end());
+                continue;
+            }
+
+            // walk back over cells first reached one step earlier
+            path.resize(steps);
+            for (int back = steps; back > 0; back--) {
+                path[back - 1] = cell;
+                for (int d = 0; back > 1 && d < 4; d++) {
+                    int prev = neighbour(cell, d);
+                    if (prev >= 0 && scratch[prev].seenGen == seenGen && scratch[prev].steps == back - 1) {
+                        cell = prev;
+                        break;
+                    }
+                }
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Replays path from the body loaded by loadBody, eating the bonus where the
+// path crosses it, and checks that the new head can still reach the new
+// tail. This restamps the chain only, from the copy taken by loadBody, and
+// leaves it describing the replayed body.
+template <class Core>
+bool BasicAutopilot<Core>::tailReachableAfter(const Core &core, int from, const std::vector<int> &path) {
+    Cell bonus = core.getBonus();
+    int bonusCell = core.inBoard(bonus) ? bonus.y * width + bonus.x : -1,
+        steps = static_cast<int>(path.size()),
+        len = length,
+        grow = growth;
+
+    for (int cell: path) {
+        if (cell == bonusCell) {
+            grow += 3;
+            bonusCell = -1;
+        }
+        if (grow > 0) {
+            len++;
+            grow--;
+        }
+    }
+
+    // positions in the body followed by the path; the new body is the last
+    // len of them and the chain starts at base
+    int total = length + steps, first = total - len,
+        base = length - static_cast<int>(chain.size());
+    if (first < base)
+        return false;
+
+    nextGeneration(&Scratch::occupiedGen, occupiedGen);
+
+    auto stamp = [&](int position, int cell) {
+        scratch[cell].occupiedGen = occupiedGen;
+        scratch[cell].freeAt = position < first ? 0 : len - (total - 1 - position) + grow;
+    };
+    for (int c = 0; c < static_cast<int>(chain.size()); c++)
+        stamp(base + c, chain[c]);
+    for (int s = 0; s < steps; s++)
+        stamp(length + s, path[s]);
+
+    int tail = first < length ? chain[first - base] : path[first - length],
+        behind = steps >= 2 ? path[steps - 2] : from;
+    return search(core, path.back(), tail, behind, probe);
+}
+
+template <class Core>
+Direction BasicAutopilot<Core>::fallback(const Core &core, int headCell, int behind) {
+    int candidates[5], count = 0, cycle = cycleNext(headCell);
+    if (cycle >= 0)
+        candidates[count++] = cycle;
+    for (int dir = 0; dir < 4; dir++) {
+        int cell = neighbour(headCell, dir);
+        if (cell >= 0 && cell != cycle)
+            candidates[count++] = cell;
+    }
+
+    int free[5], freeCount = 0;
+    for (int i = 0; i < count; i++) {
+        int cell = candidates[i];
+        if (cell == behind || !isFree(core, cell))
+            continue;
+        free[freeCount++] = cell;
+
+        route.assign(1, cell);
+        if (tailReachableAfter(core, headCell, route))
+            return towards(headCell, cell);
+    }
+
+    if (freeCount == 0)
+        return core.getDirection();
+
+    // boxed in or out of budget: put off dying for as long as possible by
+    // heading where the most free cells are left
+    int best = free[0];
+    if (freeCount > 1) {
+        Cell from[5];
+        int areas[5];
+        for (int i = 0; i < freeCount; i++)
+            from[i] = Cell(free[i] % width, free[i] / width);
+
+        bits.load(core);
+        bits.reachableAreas(from, freeCount, areas);
+        for (int i = 1, bestArea = areas[0]; i < freeCount; i++)
+            if (areas[i] > bestArea) {
+                bestArea = areas[i];
+                best = free[i];
+            }
+    }
+    return towards(headCell, best);
+}
+
+template <class Core>
+Direction BasicAutopilot<Core>::next(const Core &core) {
+    if (core.getStatus() != SnakeCoreBase::Running || core.getLength() == 0)
+        return core.getDirection();
+
+    if (core.getWidth() != width || core.getHeight() != height)
+        reset(core);
+    left = budget;
+
+    Cell head = core.getHead(), bonus = core.getBonus();
+    int headCell = head.y * width + head.x,
+        behind = neighbour(headCell, static_cast<int>(core.getDirection()) ^ 1);
+
+    // the plan holds until the bonus moves or something blocks its next cell
+    if (!plan.empty() && planHead == headCell && planBonus == bonus && isFree(core, plan.back())) {
+        planHead = plan.back();
+        plan.pop_back();
+        return towards(headCell, planHead);
+    }
+
+    plan.clear();
+    loadBody(core);
+
+    if (core.inBoard(bonus) &&
+            search(core, headCell, bonus.y * width + bonus.x, behind, route) &&
+            tailReachableAfter(core, headCell, route)) {
+        plan.assign(route.rbegin(), route.rend() - 1);
+        planBonus = bonus;
+        planHead = route.front();
+        return towards(headCell, planHead);
+    }
+
+    return fallback(core, headCell, behind);
+}
+
+template <class Core>
+void BasicAutopilot<Core>::forget() {
+    plan.clear();
+    planHead = -1;
+}
+
+template class BasicAutopilot<SnakeCore>;
+template class BasicAutopilot<SnakeCore40x40>;
@@ -0,0 +1,100 @@
+#ifndef AUTOPILOT_H
+#define AUTOPILOT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bitboard.h"
+#include "snakecore.h"
+
+// Plays instead of the keyboard: next() picks the direction for the coming
+// step, to be handed to changeDirection right before move().
+//
+// The snake heads for the bonus along the shortest path A* finds, knowing
+// that body segments clear out of the way as it advances, and only commits
+// to that path if the tail is still reachable once the bonus is eaten.
+// Otherwise it follows a Hamiltonian cycle of the board, or, where the body
+// or barriers break the cycle, any move that keeps the tail in reach, and
+// failing that the move with the most free cells reachable behind it.
+//
+// A plan is kept for as long as nothing gets in its way, so most steps cost
+// a couple of lookups. Planning expands at most `budget` cells per step and
+// a search cut short counts as failed, which bounds a step on any board.
+// The first step on a new board size allocates 16 bytes of scratch per cell.
+template <class Core>
+class BasicAutopilot {
+
+    const static int defaultBudget;
+    const static int blocked;
+
+    // per cell state; the generation stamps spare clearing the whole board
+    // before every search
+    struct Scratch {
+        std::uint32_t occupiedGen;
+        std::int32_t freeAt;    // entering on step s needs s > freeAt
+        std::uint32_t seenGen;
+        std::int32_t steps;     // first arrival in the current search
+    };
+
+    struct Node {
+        int cost, steps, cell;
+        Cell at;
+        bool operator<(const Node &rhs) const {
+            // a max heap: lowest cost first, then the deepest node
+            return cost != rhs.cost ? cost > rhs.cost : steps < rhs.steps;
+        }
+    };
+
+    int width, height, budget, left;
+    std::vector<Scratch> scratch;
+    std::uint32_t occupiedGen, seenGen;
+
+    // body cells from the tail towards the head, the part that can move out
+    // of the way within one search
+    std::vector<int> chain;
+    int length, growth;
+
+    // cells still to walk, the next one at the back
+    std::vector<int> plan;
+    Cell planBonus;
+    int planHead;
+
+    std::vector<Node> open;
+    std::vector<int> route, probe;
+
+    // for the last resort, see fallback
+    BoardBits bits;
+
+    void reset(const Core &core);
+    void nextGeneration(std::uint32_t Scratch::*stamp, std::uint32_t &gen);
+    int freeAt(const Core &core, int cell, const Cell &chunk) const;
+    bool isFree(const Core &core, int cell) const;
+    int neighbour(int cell, int dir) const;
+    Direction towards(int from, int to) const;
+    int cycleNext(int cell) const;
+
+    void loadBody(const Core &core);
+    bool search(const Core &core, int from, int to, int avoid, std::vector<int> &path);
+    bool tailReachableAfter(const Core &core, int from, const std::vector<int> &path);
+    Direction fallback(const Core &core, int headCell, int behind);
+
+public:
+
+    BasicAutopilot();
+
+    // cells a single step may expand while planning
+    void setBudget(int cells);
+    int getBudget() const;
+
+    Direction next(const Core &core);
+
+    // drops the plan, to be called before a new game on the same core
+    void forget();
+};
+
+typedef BasicAutopilot<SnakeCore> Autopilot;
+
+extern template class BasicAutopilot<SnakeCore>;
+extern template class BasicAutopilot<SnakeCore40x40>;
+
+#endif // AUTOPILOT_H
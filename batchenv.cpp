@@ -0,0 +1,253 @@
+#include "batchenv.h"
+
+#include <cassert>
+#include <cstring>
+
+static int popCount(std::uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int bits = 0;
+    for (; word; word &= word - 1)
+        bits++;
+    return bits;
+#endif
+}
+
+static int lowestBit(std::uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+BatchEnv::BatchEnv(int _count, int _width, int _height, std::uint64_t _firstSeed) :
+    count {_count},
+    width {_width},
+    height {_height},
+    cells {_width * _height},
+    words {(_width * _height + 63) / 64},
+    firstSeed {_firstSeed},
+    head(_count),
+    length(_count),
+    growth(_count),
+    bonus(_count),
+    ticks(_count),
+    finalLength(_count, 0),
+    direction(_count),
+    rngState(_count),
+    episode(_count, 0),
+    body(static_cast<size_t>(_count) * _width * _height),
+    occupied(static_cast<size_t>(_count) * ((_width * _height + 63) / 64)) {
+
+    assert(count > 0 && width >= 5 && height >= 5 && width <= 0x7FFF && height <= 0x7FFF);
+    for (int i = 0; i < count; i++)
+        start(i);
+}
+
+int BatchEnv::size() const {
+    return count;
+}
+
+int BatchEnv::getWidth() const {
+    return width;
+}
+
+int BatchEnv::getHeight() const {
+    return height;
+}
+
+int BatchEnv::planeWords() const {
+    return words;
+}
+
+int BatchEnv::observationWords() const {
+    return PlaneCount * words;
+}
+
+bool BatchEnv::isOccupied(int i, int cell) const {
+    return occupied[static_cast<size_t>(i) * words + cell / 64] >> (cell % 64) & 1;
+}
+
+void BatchEnv::setOccupied(int i, int cell, bool on) {
+    std::uint64_t &word = occupied[static_cast<size_t>(i) * words + cell / 64],
+                  bit = static_cast<std::uint64_t>(1) << (cell % 64);
+    word = on ? word | bit : word & ~bit;
+}
+
+// the k-th free cell in index order, k uniform; the same draw SnakeCore
+// makes for its first bonus, while its free list is still in index order
+void BatchEnv::placeBonus(int i, Random &rng) {
+    int free = cells - length[i];
+    if (free == 0) {
+        bonus[i] = -1;
+        return;
+    }
+
+    int k = rng.bounded(0, free);
+    const std::uint64_t *board = &occupied[static_cast<size_t>(i) * words];
+    for (int w = 0; ; w++) {
+        std::uint64_t empty = ~board[w];
+        if (w == words - 1 && cells % 64 != 0)
+            empty &= (static_cast<std::uint64_t>(1) << (cells % 64)) - 1;
+
+        int n = popCount(empty);
+        if (k >= n) {
+            k -= n;
+            continue;
+        }
+        for (; k > 0; k--)
+            empty &= empty - 1;
+        bonus[i] = w * 64 + lowestBit(empty);
+        return;
+    }
+}
+
+// as SnakeCore::init: a random cell away from the border, the second
+// segment next to it in a random direction, heading away from it
+void BatchEnv::start(int i) {
+    std::uint64_t seed = firstSeed + episode[i]++ * count + i;
+    Random rng(seed);
+
+    // the same draws in the same order: x, y, then the direction
+    int marginX = width / 5, marginY = height / 5;
+    int x = rng.bounded(marginX, width - marginX);
+    int y = rng.bounded(marginY, height - marginY);
+    Cell first(x, y),
+         second = first.next(static_cast<Direction>(rng.bounded(0, 3)));
+
+    std::memset(&occupied[static_cast<size_t>(i) * words], 0, words * sizeof(std::uint64_t));
+    std::int32_t *ring = &body[static_cast<size_t>(i) * cells];
+    ring[0] = first.y * width + first.x;
+    ring[1] = second.y * width + second.x;
+    setOccupied(i, ring[0], true);
+    setOccupied(i, ring[1], true);
+
+    head[i] = 0;
+    length[i] = 2;
+    growth[i] = 0;
+    ticks[i] = 0;
+    direction[i] = static_cast<std::uint8_t>(second.calcDirection(first));
+
+    placeBonus(i, rng);
+    rngState[i] = rng.getState();
+}
+
+void BatchEnv::reset() {
+    for (int i = 0; i < count; i++)
+        start(i);
+}
+
+void BatchEnv::observe(std::uint64_t *observations) const {
+    size_t stride = static_cast<size_t>(PlaneCount) * words;
+    for (int i = 0; i < count; i++) {
+        std::uint64_t *out = observations + i * stride;
+        std::memcpy(out + BodyPlane * words, &occupied[static_cast<size_t>(i) * words],
+                    words * sizeof(std::uint64_t));
+
+        std::memset(out + HeadPlane * words, 0, 2 * words * sizeof(std::uint64_t));
+        int cell = body[static_cast<size_t>(i) * cells + head[i]];
+        out[HeadPlane * words + cell / 64] |= static_cast<std::uint64_t>(1) << (cell % 64);
+        if (bonus[i] >= 0)
+            out[BonusPlane * words + bonus[i] / 64] |= static_cast<std::uint64_t>(1) << (bonus[i] % 64);
+    }
+}
+
+// The same move as SnakeCore::move, one game after another.
+void BatchEnv::step(const std::uint8_t *actions, std::uint64_t *observations, float *rewards, std::uint8_t *dones) {
+    const static int dx[4] = {-1, 1, 0, 0};
+    const static int dy[4] = {0, 0, -1, 1};
+
+    for (int i = 0; i < count; i++) {
+        int dir = direction[i], action = actions[i] & 3;
+        if ((action ^ 1) != dir)
+            direction[i] = static_cast<std::uint8_t>(dir = action);
+
+        std::int32_t *ring = &body[static_cast<size_t>(i) * cells];
+        int headCell = ring[head[i]],
+            x = headCell % width + dx[dir],
+            y = headCell / width + dy[dir],
+            next = y * width + x;
+
+        float reward = 0;
+        bool died = x < 0 || x >= width || y < 0 || y >= height || isOccupied(i, next);
+
+        if (died) {
+            finalLength[i] = length[i];
+            reward = -1;
+            start(i);
+        } else {
+            ticks[i]++;
+
+            bool eaten = next == bonus[i];
+            if (eaten) {
+                growth[i] += 3;
+                reward = 1;
+            }
+
+            int tail = head[i] + length[i] - 1;
+            if (tail >= cells)
+                tail -= cells;
+
+            if (growth[i] > 0) {
+                length[i]++;
+                growth[i]--;
+            } else {
+                setOccupied(i, ring[tail], false);
+            }
+
+            head[i] = head[i] == 0 ? cells - 1 : head[i] - 1;
+            ring[head[i]] = next;
+            setOccupied(i, next, true);
+
+            if (eaten) {
+                Random rng(rngState[i]);
+                placeBonus(i, rng);
+                rngState[i] = rng.getState();
+            }
+        }
+
+        if (rewards != nullptr)
+            rewards[i] = reward;
+        if (dones != nullptr)
+            dones[i] = died;
+    }
+
+    if (observations != nullptr)
+        observe(observations);
+}
+
+Cell BatchEnv::getHead(int i) const {
+    int cell = body[static_cast<size_t>(i) * cells + head[i]];
+    return Cell(cell % width, cell / width);
+}
+
+Cell BatchEnv::getBonus(int i) const {
+    return bonus[i] < 0 ? Cell(-1, -1) : Cell(bonus[i] % width, bonus[i] / width);
+}
+
+Direction BatchEnv::getDirection(int i) const {
+    return static_cast<Direction>(direction[i]);
+}
+
+int BatchEnv::getLength(int i) const {
+    return length[i];
+}
+
+int BatchEnv::getTicks(int i) const {
+    return ticks[i];
+}
+
+int BatchEnv::getFinalLength(int i) const {
+    return finalLength[i];
+}
+
+std::uint64_t BatchEnv::getSeed(int i) const {
+    return firstSeed + (episode[i] - 1) * count + i;
+}
@@ -0,0 +1,88 @@
+#ifndef BATCHENV_H
+#define BATCHENV_H
+
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+// N games on boards of one size, stepped together for training agents. The
+// state is kept one array per field instead of one SnakeCore per game:
+// heads, lengths, bonuses and directions are N entries each, the bodies
+// are N rings of width*height cells back to back and the occupancy is N
+// bitboards back to back, so a step walks a few contiguous arrays and
+// allocates nothing.
+//
+// The rules are those of SnakeCore on a board without barriers. Game i
+// plays episode k with seed firstSeed + k*N + i, and starts exactly as
+// SnakeCore(width, height, seed) would; bonuses after the first one land
+// elsewhere, the free cells are drawn in a different order.
+class BatchEnv {
+
+public:
+    // bit planes of an observation, each planeWords() words, cell y*width+x
+    // in bit x%64 of word (y*width+x)/64
+    enum Plane {BodyPlane, HeadPlane, BonusPlane, PlaneCount};
+
+private:
+    int count, width, height, cells, words;
+    std::uint64_t firstSeed;
+
+    // one entry per game
+    std::vector<std::int32_t> head;         // slot of the head in the game's ring
+    std::vector<std::int32_t> length;
+    std::vector<std::int32_t> growth;       // steps left during which the tail stays put
+    std::vector<std::int32_t> bonus;        // cell, -1 once the board is full
+    std::vector<std::int32_t> ticks;
+    std::vector<std::int32_t> finalLength;  // of the game that ended on the last step
+    std::vector<std::uint8_t> direction;
+    std::vector<std::uint64_t> rngState, episode;
+
+    // count rings of cells entries; body[i*cells + head[i]] is the head of
+    // game i and the following length - 1 slots, wrapping, run to the tail
+    std::vector<std::int32_t> body;
+
+    // count bitboards of words words, the body cells of each game
+    std::vector<std::uint64_t> occupied;
+
+    void start(int i);
+    void placeBonus(int i, Random &rng);
+    bool isOccupied(int i, int cell) const;
+    void setOccupied(int i, int cell, bool on);
+
+public:
+
+    // width and height at least 5, as in snakesim
+    BatchEnv(int _count, int _width, int _height, std::uint64_t _firstSeed);
+
+    int size() const;
+    int getWidth() const;
+    int getHeight() const;
+
+    int planeWords() const;
+    int observationWords() const; // per game, PlaneCount planes
+
+    // every game starts a new episode
+    void reset();
+
+    // writes size() observations of observationWords() words each
+    void observe(std::uint64_t *observations) const;
+
+    // One step of every game; actions[i] is a Direction, one opposite to
+    // the current direction is ignored. A game that dies starts its next
+    // episode right away: dones[i] is set, getFinalLength(i) tells how it
+    // ended and the observation is the first of the new episode. Rewards
+    // are 1 for a bonus eaten, -1 for dying, 0 otherwise. observations,
+    // rewards and dones may each be null.
+    void step(const std::uint8_t *actions, std::uint64_t *observations, float *rewards, std::uint8_t *dones);
+
+    Cell getHead(int i) const;
+    Cell getBonus(int i) const;
+    Direction getDirection(int i) const;
+    int getLength(int i) const;
+    int getTicks(int i) const;
+    int getFinalLength(int i) const;
+    std::uint64_t getSeed(int i) const; // of the episode being played
+};
+
+#endif // BATCHENV_H
@@ -0,0 +1,35 @@
+#include "batchrunner.h"
+
+#include <algorithm>
+
+const char* GameResult::causeName(Cause cause) {
+    static const char *names[CauseCount] = {"wall", "barrier", "body", "step limit"};
+    return names[cause];
+}
+
+BatchSummary::BatchSummary() :
+    games {0},
+    ticks {0},
+    score {0},
+    length {0},
+    maxScore {0},
+    causes {0} { }
+
+void BatchSummary::add(const GameResult &result) {
+    games++;
+    ticks += result.ticks;
+    score += result.score;
+    length += result.length;
+    maxScore = std::max(maxScore, result.score);
+    causes[result.cause]++;
+}
+
+void BatchSummary::merge(const BatchSummary &other) {
+    games += other.games;
+    ticks += other.ticks;
+    score += other.score;
+    length += other.length;
+    maxScore = std::max(maxScore, other.maxScore);
+    for (int i = 0; i < GameResult::CauseCount; i++)
+        causes[i] += other.causes[i];
+}
@@ -0,0 +1,119 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "snakecore.h"
+#include "workpool.h"
+
+struct GameResult {
+    enum Cause {Wall, Barrier, Body, StepLimit, CauseCount};
+
+    std::uint64_t seed;
+    int score, length, ticks;
+    Cause cause;
+
+    static const char* causeName(Cause cause);
+};
+
+// Totals over a set of games; each worker keeps its own and they are added
+// up once the batch is done.
+struct BatchSummary {
+    long long games, ticks, score, length;
+    int maxScore;
+    long long causes[GameResult::CauseCount];
+
+    BatchSummary();
+
+    void add(const GameResult &result);
+    void merge(const BatchSummary &other);
+};
+
+// Plays games with seeds firstSeed, firstSeed + 1, ... on a WorkPool. Each
+// worker owns one core and one driver, built on its first game and reused
+// through SnakeCore::restart and Driver::forget for every later one, so a
+// batch allocates nothing per game once the workers are warm. Game i only
+// depends on its seed, the results do not change with the number of threads.
+//
+// Driver needs a default constructor, Direction next(const Core&) and
+// void forget(); BasicAutopilot is one.
+template <class Core, class Driver>
+class BatchRunner {
+
+    struct Worker {
+        Core core;
+        Driver driver;
+        BatchSummary summary;
+
+        Worker(int width, int height) : core(width, height, 0) { }
+    };
+
+    WorkPool &pool;
+    int width, height;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    static GameResult::Cause causeOf(const Core &core) {
+        Cell next = core.getHead().next(core.getDirection());
+        if (!core.inBoard(next))
+            return GameResult::Wall;
+        return core.inBarrier(next) ? GameResult::Barrier : GameResult::Body;
+    }
+
+public:
+
+    // one game from seed on core, as run plays each of its games
+    static GameResult play(Core &core, Driver &driver, std::uint64_t seed, int maxSteps) {
+        core.restart(seed);
+        driver.forget();
+        core.start();
+
+        GameResult::Cause cause = GameResult::StepLimit;
+        for (int step = 0; step < maxSteps; step++) {
+            core.changeDirection(driver.next(core));
+            if (!core.move()) {
+                cause = causeOf(core);
+                break;
+            }
+        }
+
+        return GameResult {seed, core.getScore(), core.getLength(), core.getTime(), cause};
+    }
+
+    BatchRunner(WorkPool &_pool, int _width, int _height) :
+        pool(_pool),
+        width {_width},
+        height {_height},
+        workers(_pool.size()) { }
+
+    // results, when given, gets one entry per game in seed order
+    BatchSummary run(std::uint64_t firstSeed, std::int64_t games, int maxSteps,
+                     std::vector<GameResult> *results = nullptr) {
+        if (results != nullptr)
+            results -> resize(static_cast<size_t>(games));
+
+        // every worker writes only its own summary and its own games' slots
+        pool.run(games, [&](int id, std::int64_t game) {
+            // built by the thread that plays on it, on memory near that thread
+            if (!workers[id])
+                workers[id].reset(new Worker(width, height));
+            Worker &worker = *workers[id];
+
+            GameResult result = play(worker.core, worker.driver, firstSeed + static_cast<std::uint64_t>(game), maxSteps);
+            worker.summary.add(result);
+            if (results != nullptr)
+                (*results)[static_cast<size_t>(game)] = result;
+        });
+
+        BatchSummary total;
+        for (auto &worker: workers)
+            if (worker) {
+                total.merge(worker -> summary);
+                worker -> summary = BatchSummary();
+            }
+        return total;
+    }
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,297 @@
+#include "bitboard.h"
+
+#include <algorithm>
+
+#include "snakecore.h"
+
+// AVX2 is picked at run time where the compiler can target it per
+// function, so the same binary still runs on CPUs without it.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BITBOARD_AVX2 1
+#define BITBOARD_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+const static int padRows = 2;
+
+static int popCount(std::uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int bits = 0;
+    for (; word; word &= word - 1)
+        bits++;
+    return bits;
+#endif
+}
+
+// every bit of pro reachable from gen along a run of pro bits, both ways;
+// the occluded Kogge-Stone fill, six doubling shifts per direction
+static std::uint64_t fillRow(std::uint64_t gen, std::uint64_t pro) {
+    std::uint64_t up = gen, upPro = pro, down = gen, downPro = pro;
+    for (int shift = 1; shift < 64; shift *= 2) {
+        up |= upPro & (up << shift);
+        upPro &= upPro << shift;
+        down |= downPro & (down >> shift);
+        downPro &= downPro >> shift;
+    }
+    return up | down;
+}
+
+#ifdef BITBOARD_AVX2
+template <int Shift>
+BITBOARD_TARGET static inline void fillStep(__m256i &up, __m256i &upPro, __m256i &down, __m256i &downPro) {
+    up = _mm256_or_si256(up, _mm256_and_si256(upPro, _mm256_slli_epi64(up, Shift)));
+    upPro = _mm256_and_si256(upPro, _mm256_slli_epi64(upPro, Shift));
+    down = _mm256_or_si256(down, _mm256_and_si256(downPro, _mm256_srli_epi64(down, Shift)));
+    downPro = _mm256_and_si256(downPro, _mm256_srli_epi64(downPro, Shift));
+}
+
+// fillRow on four words at once
+BITBOARD_TARGET static inline __m256i fillRows(__m256i gen, __m256i pro) {
+    __m256i up = gen, upPro = pro, down = gen, downPro = pro;
+    fillStep<1>(up, upPro, down, downPro);
+    fillStep<2>(up, upPro, down, downPro);
+    fillStep<4>(up, upPro, down, downPro);
+    fillStep<8>(up, upPro, down, downPro);
+    fillStep<16>(up, upPro, down, downPro);
+    fillStep<32>(up, upPro, down, downPro);
+    return _mm256_or_si256(up, down);
+}
+
+// Fills four sets at once through one mask of one word per row: lane l
+// of row y is word 4 * (y + 1) + l of lanes, with a zero row before the
+// first and after the last. Sweeps go row by row as in Bitboard::sweep,
+// each row seeing the one just grown, until one changes nothing.
+BITBOARD_TARGET static void fillLanes(std::uint64_t *lanes, const std::uint64_t *mask, int height) {
+    bool down = true, changed;
+    do {
+        __m256i diff = _mm256_setzero_si256();
+        for (int i = 0; i < height; i++) {
+            int y = down ? i : height - 1 - i;
+            std::uint64_t *at = lanes + 4 * (y + 1);
+
+            __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at)),
+                    above = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at - 4)),
+                    below = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at + 4)),
+                    pro = _mm256_set1_epi64x(static_cast<long long>(mask[y]));
+
+            __m256i gen = _mm256_and_si256(_mm256_or_si256(old, _mm256_or_si256(above, below)), pro),
+                    grown = fillRows(gen, pro);
+
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(grown, old));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(at), grown);
+        }
+        changed = !_mm256_testz_si256(diff, diff);
+        down = !down;
+    } while (changed);
+}
+#endif
+
+bool Bitboard::hasSimd() {
+#ifdef BITBOARD_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+Bitboard::Bitboard() :
+    width {0},
+    height {0},
+    stride {1} { }
+
+Bitboard::Bitboard(int _width, int _height) : Bitboard() {
+    reset(_width, _height);
+}
+
+void Bitboard::reset(int _width, int _height) {
+    width = _width;
+    height = _height;
+    stride = (_width + 63) / 64;
+    words.assign(static_cast<size_t>(_height + padRows) * stride, 0);
+}
+
+void Bitboard::clear() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+int Bitboard::getWidth() const {
+    return width;
+}
+
+int Bitboard::getHeight() const {
+    return height;
+}
+
+int Bitboard::getStride() const {
+    return stride;
+}
+
+bool Bitboard::test(const Cell &chunk) const {
+    return row(chunk.y)[chunk.x / 64] >> (chunk.x % 64) & 1;
+}
+
+void Bitboard::set(const Cell &chunk) {
+    row(chunk.y)[chunk.x / 64] |= static_cast<std::uint64_t>(1) << (chunk.x % 64);
+}
+
+void Bitboard::unset(const Cell &chunk) {
+    row(chunk.y)[chunk.x / 64] &= ~(static_cast<std::uint64_t>(1) << (chunk.x % 64));
+}
+
+int Bitboard::count() const {
+    int bits = 0;
+    for (int y = 0; y < height; y++)
+        for (int k = 0; k < stride; k++)
+            bits += popCount(row(y)[k]);
+    return bits;
+}
+
+void Bitboard::assignNeither(const Bitboard &a, const Bitboard &b) {
+    for (int y = 0; y < height; y++)
+        for (int k = 0; k < stride; k++) {
+            int bits = std::min(64, width - 64 * k);
+            std::uint64_t board = bits == 64 ? ~static_cast<std::uint64_t>(0) : (static_cast<std::uint64_t>(1) << bits) - 1;
+            row(y)[k] = board & ~(a.row(y)[k] | b.row(y)[k]);
+        }
+}
+
+// Each word takes in the rows above and below and the bit carried over from
+// the words beside it, then fills along its row through the mask. Top down
+// a column fills in one sweep, bottom up the next one fills the other way.
+bool Bitboard::sweep(const Bitboard &mask, bool down) {
+    bool changed = false;
+    for (int i = 0; i < height; i++) {
+        int y = down ? i : height - 1 - i;
+        std::uint64_t *at = row(y);
+        const std::uint64_t *above = row(y - 1), *below = row(y + 1), *pro = mask.row(y);
+
+        for (int k = 0; k < stride; k++) {
+            std::uint64_t gen = at[k] | above[k] | below[k];
+            if (k > 0)
+                gen |= at[k - 1] >> 63;
+            if (k + 1 < stride)
+                gen |= at[k + 1] << 63;
+
+            std::uint64_t grown = fillRow(gen & pro[k], pro[k]);
+            changed |= grown != at[k];
+            at[k] = grown;
+        }
+    }
+    return changed;
+}
+
+int Bitboard::fill(const Bitboard &mask) {
+    for (int y = 0; y < height; y++)
+        for (int k = 0; k < stride; k++)
+            row(y)[k] &= mask.row(y)[k];
+
+    // a sweep that changes nothing ends it
+    bool down = true;
+    while (sweep(mask, down))
+        down = !down;
+
+    return count();
+}
+
+void Bitboard::fillMany(Bitboard *const *sets, int count, const Bitboard &mask, std::vector<std::uint64_t> &lanes) {
+#ifdef BITBOARD_AVX2
+    if (mask.stride == 1 && hasSimd()) {
+        int height = mask.height;
+        lanes.assign(4 * static_cast<size_t>(height + 2), 0);
+
+        for (int first = 0; first < count; first += 4) {
+            int group = std::min(4, count - first);
+            for (int y = 0; y < height; y++)
+                for (int l = 0; l < 4; l++)
+                    lanes[4 * (y + 1) + l] = l < group ? sets[first + l] -> row(y)[0] & mask.row(y)[0] : 0;
+
+            fillLanes(lanes.data(), mask.row(0), height);
+
+            for (int y = 0; y < height; y++)
+                for (int l = 0; l < group; l++)
+                    sets[first + l] -> row(y)[0] = lanes[4 * (y + 1) + l];
+        }
+        return;
+    }
+#endif
+
+    (void) lanes;
+    for (int i = 0; i < count; i++)
+        sets[i] -> fill(mask);
+}
+
+template <class Core>
+void BoardBits::load(const Core &core) {
+    int width = core.getWidth(), height = core.getHeight();
+    if (body.getWidth() != width || body.getHeight() != height) {
+        body.reset(width, height);
+        barriers.reset(width, height);
+        bonus.reset(width, height);
+        open.reset(width, height);
+        for (auto &set: reach)
+            set.reset(width, height);
+    } else {
+        body.clear();
+        barriers.clear();
+        bonus.clear();
+    }
+
+    for (Cell chunk: core)
+        body.set(chunk);
+    for (const Cell &chunk: core.getBarriers())
+        barriers.set(chunk);
+    if (core.inBoard(core.getBonus()))
+        bonus.set(core.getBonus());
+    open.assignNeither(body, barriers);
+}
+
+const Bitboard& BoardBits::getBody() const {
+    return body;
+}
+
+const Bitboard& BoardBits::getBarriers() const {
+    return barriers;
+}
+
+const Bitboard& BoardBits::getBonus() const {
+    return bonus;
+}
+
+const Bitboard& BoardBits::getOpen() const {
+    return open;
+}
+
+void BoardBits::seed(Bitboard &set, const Cell &from) const {
+    set.clear();
+    for (int dir = 0; dir < 4; dir++) {
+        Cell next = from.next(static_cast<Direction>(dir));
+        if (next.x >= 0 && next.x < open.getWidth() && next.y >= 0 && next.y < open.getHeight() && open.test(next))
+            set.set(next);
+    }
+}
+
+int BoardBits::reachableArea(const Cell &from) {
+    seed(reach[0], from);
+    return reach[0].fill(open);
+}
+
+void BoardBits::reachableAreas(const Cell *from, int count, int *areas) {
+    for (int first = 0; first < count; first += 4) {
+        int group = std::min(4, count - first);
+        Bitboard *sets[4];
+        for (int l = 0; l < group; l++) {
+            seed(reach[l], from[first + l]);
+            sets[l] = &reach[l];
+        }
+
+        Bitboard::fillMany(sets, group, open, lanes);
+        for (int l = 0; l < group; l++)
+            areas[first + l] = reach[l].count();
+    }
+}
+
+template void BoardBits::load<SnakeCore>(const SnakeCore &core);
+template void BoardBits::load<SnakeCore40x40>(const SnakeCore40x40 &core);
@@ -0,0 +1,99 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+// One bit per cell, row by row: row y takes stride() 64-bit words and
+// cell (x, y) is bit x % 64 of word x / 64 of that row. A flood fill sweeps
+// the rows top down and bottom up in turn; each word takes in the rows
+// next to it and then fills along its row with a handful of shifts, ands
+// and ors, so a fill costs a few sweeps rather than a visit per cell.
+//
+// A sweep is sequential from row to row, so SIMD goes across fills
+// instead: fillMany runs four fills through one mask side by side in the
+// lanes of an AVX2 register, on boards up to 64 wide and on CPUs that
+// have it, and one fill after another otherwise.
+class Bitboard {
+
+    int width, height, stride;
+
+    // a zero row above the board and one below it
+    std::vector<std::uint64_t> words;
+
+    std::uint64_t* row(int y) { return &words[static_cast<size_t>(y + 1) * stride]; }
+    const std::uint64_t* row(int y) const { return &words[static_cast<size_t>(y + 1) * stride]; }
+
+    bool sweep(const Bitboard &mask, bool down);
+
+public:
+
+    Bitboard();
+    Bitboard(int _width, int _height);
+
+    // clears; allocates only when the board grows
+    void reset(int _width, int _height);
+    void clear();
+
+    int getWidth() const;
+    int getHeight() const;
+    int getStride() const;
+
+    bool test(const Cell &chunk) const;
+    void set(const Cell &chunk);
+    void unset(const Cell &chunk);
+    int count() const;
+
+    // this becomes the cells of the board in neither a nor b, all three the
+    // same size
+    void assignNeither(const Bitboard &a, const Bitboard &b);
+
+    // Grows this set through mask: afterwards it holds every cell of mask
+    // connected to it by steps up, down, left or right. Cells of this
+    // outside mask are dropped. Returns the number of cells held.
+    int fill(const Bitboard &mask);
+
+    // fill on each of sets, all the size of mask; lanes is scratch kept by
+    // the caller so that repeated calls allocate nothing
+    static void fillMany(Bitboard *const *sets, int count, const Bitboard &mask, std::vector<std::uint64_t> &lanes);
+
+    // whether fillMany runs the AVX2 kernel on this CPU
+    static bool hasSimd();
+};
+
+// Body, barriers and bonus of a game as separate planes, plus the cells
+// that are neither body nor barrier. Loading sets one bit per segment and
+// barrier and derives the open cells a word at a time; the planes are kept
+// between loads, so only a new board size allocates.
+class BoardBits {
+
+    Bitboard body, barriers, bonus, open;
+
+    // scratch for the reachable area queries
+    Bitboard reach[4];
+    std::vector<std::uint64_t> lanes;
+
+    void seed(Bitboard &set, const Cell &from) const;
+
+public:
+
+    template <class Core>
+    void load(const Core &core);
+
+    const Bitboard& getBody() const;
+    const Bitboard& getBarriers() const;
+    const Bitboard& getBonus() const;
+    const Bitboard& getOpen() const;
+
+    // free cells the head could walk to from `from` if nothing moved, not
+    // counting from itself; the body is taken as it is, so it is a lower
+    // bound on what the snake can reach
+    int reachableArea(const Cell &from);
+
+    // reachableArea of each of from, four at a time with fillMany
+    void reachableAreas(const Cell *from, int count, int *areas);
+};
+
+#endif // BITBOARD_H
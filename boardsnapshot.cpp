@@ -0,0 +1,76 @@
+#include "boardsnapshot.h"
+
+BoardSnapshot::BoardSnapshot() :
+    width {0},
+    height {0},
+    status {SnakeCore::Origin},
+    time {0},
+    score {0},
+    head {-1, -1},
+    bonus {-1, -1},
+    full {false} { }
+
+unsigned char BoardSnapshot::valueOf(const SnakeCore &core, const Cell &chunk) {
+    if (core.inBarrier(chunk))
+        return BarrierCell;
+    if (core.inBody(chunk))
+        return chunk == core.getHead() ? BodyHeadCell : BodyCell;
+    if (chunk == core.getBonus())
+        return BonusCell;
+    return BackgroundCell;
+}
+
+void BoardSnapshot::capture(SnakeCore &core) {
+    width = core.getWidth();
+    height = core.getHeight();
+    status = core.getStatus();
+    time = core.getTime();
+    score = core.getScore();
+    head = core.getHead();
+    bonus = core.getBonus();
+
+    full = core.isAllDirty();
+    changes.clear();
+
+    if (full) {
+        cells.resize(static_cast<size_t>(width) * height);
+        for (int y = 0, cell = 0; y < height; y++)
+            for (int x = 0; x < width; x++, cell++)
+                cells[cell] = valueOf(core, Cell(x, y));
+    } else {
+        cells.clear();
+        for (auto &chunk: core.getDirtyCells())
+            if (core.inBoard(chunk))
+                changes.push_back({chunk.y * width + chunk.x, valueOf(core, chunk)});
+    }
+
+    core.clearDirtyCells();
+}
+
+const int SnapshotBuffer::freshBit = 4;
+
+SnapshotBuffer::SnapshotBuffer() :
+    backSlot {0},
+    frontSlot {1},
+    middleSlot {2} { }
+
+bool SnapshotBuffer::canPublish() const {
+    return !(middleSlot.load(std::memory_order_acquire) & freshBit);
+}
+
+BoardSnapshot& SnapshotBuffer::back() {
+    return buffers[backSlot];
+}
+
+// only called after canPublish(), and the reader can only clear the bit in
+// between, so the slot given back is always one the reader is done with
+void SnapshotBuffer::publish() {
+    backSlot = middleSlot.exchange(backSlot | freshBit, std::memory_order_acq_rel) & ~freshBit;
+}
+
+const BoardSnapshot* SnapshotBuffer::acquire() {
+    if (!(middleSlot.load(std::memory_order_acquire) & freshBit))
+        return nullptr;
+    frontSlot = middleSlot.exchange(frontSlot, std::memory_order_acq_rel) & ~freshBit;
+    return &buffers[frontSlot];
+}
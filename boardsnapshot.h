@@ -0,0 +1,70 @@
+#ifndef BOARDSNAPSHOT_H
+#define BOARDSNAPSHOT_H
+
+#include <atomic>
+#include <vector>
+
+#include "snakecore.h"
+#include "utils.h"
+
+// What the board looked like at one point of the game, as handed from the
+// simulation thread to the GUI. Either a full copy of every cell or the
+// cells changed since the previous snapshot, which the reader applies to
+// its own mirror of the board.
+struct BoardSnapshot {
+
+    // what a cell shows; also the palette index of the GUI framebuffer
+    enum CellValue {BackgroundCell = 0, BodyCell, BodyHeadCell, BarrierCell, BonusCell, CellValues};
+
+    struct CellChange {
+        int cell;
+        unsigned char value;
+    };
+
+    int width, height;
+    SnakeCore::GameStatus status;
+    int time, score;
+    Cell head, bonus;
+
+    bool full;
+    std::vector<unsigned char> cells; // width * height values when full
+    std::vector<CellChange> changes;  // otherwise, in the order they happened
+
+    BoardSnapshot();
+
+    static unsigned char valueOf(const SnakeCore &core, const Cell &chunk);
+
+    // takes the state and the dirty cells of core and clears them
+    void capture(SnakeCore &core);
+};
+
+// Triple buffer between exactly one writer and one reader. The writer fills
+// back() and publish()es it, the reader acquire()s the latest one; neither
+// waits for the other. A snapshot is only replaced once it was read, so a
+// reader applying changes never misses any: while the reader is busy the
+// writer just holds on to its changes and publishes them all later.
+class SnapshotBuffer {
+
+    const static int freshBit;
+
+    BoardSnapshot buffers[3];
+    int backSlot, frontSlot;
+    std::atomic<int> middleSlot; // slot index, | freshBit while unread
+
+public:
+
+    SnapshotBuffer();
+
+    SnapshotBuffer(const SnapshotBuffer&) = delete;
+    SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+    // writer side
+    bool canPublish() const;
+    BoardSnapshot& back();
+    void publish();
+
+    // reader side, nullptr when nothing new was published
+    const BoardSnapshot* acquire();
+};
+
+#endif // BOARDSNAPSHOT_H
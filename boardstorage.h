@@ -0,0 +1,173 @@
+#ifndef BOARDSTORAGE_H
+#define BOARDSTORAGE_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Storage and geometry policies for BasicSnakeCore. Both provide the cell
+// grid, the body ring, the free-cell set and its position map, plus the
+// board bounds and cell indexing; FixedBoard makes the latter constexpr and
+// keeps everything inline in the object. copyBoard copies everything but
+// the body ring, for the core's copy assignment.
+
+// The part of std::vector that the free-cell set uses, on a fixed array.
+template <typename T, int Capacity>
+class FixedVector {
+
+    std::array<T, Capacity> items;
+    int count;
+
+public:
+
+    FixedVector() : count {0} { }
+
+    // only the items in use are copied
+    FixedVector(const FixedVector &other) : count {other.count} {
+        std::copy(other.begin(), other.end(), items.begin());
+    }
+
+    FixedVector& operator=(const FixedVector &other) {
+        count = other.count;
+        std::copy(other.begin(), other.end(), items.begin());
+        return *this;
+    }
+
+    T& operator[](int i) { return items[i]; }
+    const T& operator[](int i) const { return items[i]; }
+
+    T& back() { return items[count - 1]; }
+    void push_back(const T &item) { items[count++] = item; }
+    void pop_back() { count--; }
+    void clear() { count = 0; }
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T* begin() const { return items.data(); }
+    const T* end() const { return items.data() + count; }
+};
+
+// Any size, allocated once when the core is built.
+class DynamicBoard {
+
+    int width, height;
+
+protected:
+
+    typedef std::uint32_t Index;
+
+    const static int defaultWidth = 40;
+    const static int defaultHeight = 40;
+
+    std::vector<unsigned char> grid;
+    std::vector<Index> body, freePos;
+    std::vector<Index> freeCells;
+
+    DynamicBoard(int _width, int _height) :
+        width {_width},
+        height {_height},
+        grid(static_cast<size_t>(_width) * _height),
+        body(grid.size()),
+        freePos(grid.size()) {
+        freeCells.reserve(grid.size());
+    }
+
+    // the free cells keep room for the whole board, as above
+    DynamicBoard(const DynamicBoard &other) :
+        width {other.width},
+        height {other.height},
+        grid(other.grid),
+        body(other.body),
+        freePos(other.freePos) {
+        freeCells.reserve(grid.size());
+        freeCells = other.freeCells;
+    }
+
+    // takes the size, grid and free cells of other; the body ring is sized
+    // to match and left to the caller, which copies only the live part
+    void copyBoard(const DynamicBoard &other) {
+        width = other.width;
+        height = other.height;
+        grid = other.grid;
+        freePos = other.freePos;
+        freeCells = other.freeCells;
+        body.resize(other.body.size());
+    }
+
+    // cells keep 16 bit signed coordinates
+    static bool fits(int _width, int _height) {
+        return _width > 0 && _height > 0 && _width <= 0x7FFF && _height <= 0x7FFF;
+    }
+
+public:
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int cells() const { return width * height; }
+
+    bool contains(int x, int y) const {
+        return x >= 0 && x < width && y >= 0 && y < height;
+    }
+
+    int index(int x, int y) const {
+        return y * width + x;
+    }
+};
+
+// Width and height known at compile time: bounds and indexing fold into
+// constants, cell indices shrink to 16 bits on boards of fewer than 65536
+// cells, and nothing is allocated on the heap. A 40x40 board takes about
+// 11 KB, small enough to stay in L1 while it is played.
+template <int Width, int Height>
+class FixedBoard {
+
+    static_assert(Width > 0 && Height > 0, "empty board");
+    static_assert(Width <= 0x7FFF && Height <= 0x7FFF, "too wide for 16 bit cells");
+
+protected:
+
+    typedef typename std::conditional<Width * Height < 0x10000, std::uint16_t, std::uint32_t>::type Index;
+
+    const static int defaultWidth = Width;
+    const static int defaultHeight = Height;
+
+    std::array<unsigned char, Width * Height> grid;
+    std::array<Index, Width * Height> body, freePos;
+    FixedVector<Index, Width * Height> freeCells;
+
+    FixedBoard(int _width, int _height) {
+        assert(_width == Width && _height == Height);
+        (void) _width;
+        (void) _height;
+    }
+
+    void copyBoard(const FixedBoard &other) {
+        grid = other.grid;
+        freePos = other.freePos;
+        freeCells = other.freeCells;
+    }
+
+    static bool fits(int _width, int _height) {
+        return _width == Width && _height == Height;
+    }
+
+public:
+
+    constexpr static int getWidth() { return Width; }
+    constexpr static int getHeight() { return Height; }
+    constexpr static int cells() { return Width * Height; }
+
+    constexpr static bool contains(int x, int y) {
+        return x >= 0 && x < Width && y >= 0 && y < Height;
+    }
+
+    constexpr static int index(int x, int y) {
+        return y * Width + x;
+    }
+};
+
+#endif // BOARDSTORAGE_H
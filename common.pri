@@ -0,0 +1,17 @@
+CONFIG += c++11
+
+# qmake CONFIG+=instrument times the runner's steps, the board painting and
+# key presses into histograms, shown with F3 and exported with F4; without
+# it the SNAKE_* macros in instrument.h compile to nothing.
+CONFIG(instrument): DEFINES += SNAKE_INSTRUMENT
+
+# The following define makes your compiler emit warnings if you use
+# any Qt feature that has been marked deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# You can also make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
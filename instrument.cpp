@@ -0,0 +1,204 @@
+#include "instrument.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+LatencyHistogram Instrument::histograms[Instrument::MetricCount];
+std::atomic<qint64> Instrument::pendingInput {0};
+
+static int highestBit(quint64 value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+int LatencyHistogram::bucketOf(quint64 value) {
+    if (value < (1u << subBits))
+        return static_cast<int>(value);
+    int bit = highestBit(value);
+    return ((bit - subBits + 1) << subBits) + static_cast<int>((value >> (bit - subBits)) & ((1u << subBits) - 1));
+}
+
+quint64 LatencyHistogram::bucketLow(int bucket) {
+    if (bucket < (1 << subBits))
+        return static_cast<quint64>(bucket);
+    int shift = (bucket >> subBits) - 1;
+    return (static_cast<quint64>((1 << subBits) + (bucket & ((1 << subBits) - 1)))) << shift;
+}
+
+quint64 LatencyHistogram::bucketHigh(int bucket) {
+    if (bucket < (1 << subBits))
+        return static_cast<quint64>(bucket);
+    return bucketLow(bucket) + (static_cast<quint64>(1) << ((bucket >> subBits) - 1)) - 1;
+}
+
+void LatencyHistogram::record(quint64 value) {
+    counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    quint64 seen = maximum.load(std::memory_order_relaxed);
+    while (value > seen && !maximum.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::clear() {
+    for (auto &count: counts)
+        count.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::max() const {
+    return maximum.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    quint64 n = count();
+    return n == 0 ? 0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+}
+
+quint64 LatencyHistogram::bucket(int i) const {
+    return counts[i].load(std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::percentile(double q) const {
+    // the total is summed from the buckets read here, so a concurrent
+    // record() cannot push the target past the end
+    quint64 seen[bucketCount], n = 0;
+    for (int i = 0; i < bucketCount; i++)
+        n += seen[i] = bucket(i);
+    if (n == 0)
+        return 0;
+
+    quint64 target = std::max<quint64>(1, static_cast<quint64>(std::ceil(q * n)));
+    for (int i = 0; i < bucketCount; i++) {
+        if (seen[i] >= target)
+            return std::min(bucketHigh(i), max());
+        target -= seen[i];
+    }
+    return max();
+}
+
+qint64 Instrument::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram& Instrument::histogram(Metric metric) {
+    return histograms[metric];
+}
+
+const char* Instrument::name(Metric metric) {
+    static const char *names[MetricCount] = {"tickLatency", "paintTime", "ticksBehind", "inputLatency"};
+    return names[metric];
+}
+
+bool Instrument::isTime(Metric metric) {
+    return metric != TicksBehind;
+}
+
+// only the latest key press is timed, keys pressed within one step count once
+void Instrument::markInput() {
+    pendingInput.store(now(), std::memory_order_relaxed);
+}
+
+void Instrument::inputConsumed() {
+    if (pendingInput.load(std::memory_order_relaxed) == 0)
+        return;
+    qint64 pressed = pendingInput.exchange(0, std::memory_order_relaxed);
+    if (pressed != 0)
+        histograms[InputLatency].record(static_cast<quint64>(now() - pressed));
+}
+
+void Instrument::dropInput() {
+    pendingInput.store(0, std::memory_order_relaxed);
+}
+
+static std::string formatValue(quint64 value, bool time) {
+    char text[32];
+    if (!time)
+        std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+    else if (value < 10000)
+        std::snprintf(text, sizeof(text), "%llu ns", static_cast<unsigned long long>(value));
+    else if (value < 10000000)
+        std::snprintf(text, sizeof(text), "%.1f us", value / 1e3);
+    else
+        std::snprintf(text, sizeof(text), "%.1f ms", value / 1e6);
+    return text;
+}
+
+std::string Instrument::summary(Metric metric) {
+    const LatencyHistogram &h = histograms[metric];
+    bool time = isTime(metric);
+    char count[32];
+    std::snprintf(count, sizeof(count), "%llu", static_cast<unsigned long long>(h.count()));
+    return std::string(name(metric)) + "  p50 " + formatValue(h.percentile(0.5), time) +
+           "  p99 " + formatValue(h.percentile(0.99), time) +
+           "  max " + formatValue(h.max(), time) + "  n " + count;
+}
+
+void Instrument::writeJSON(std::string &out) {
+    auto number = [&out](quint64 value) {
+        out += std::to_string(static_cast<unsigned long long>(value));
+    };
+
+    out += "{";
+    for (int m = 0; m < MetricCount; m++) {
+        Metric metric = static_cast<Metric>(m);
+        const LatencyHistogram &h = histograms[metric];
+
+        out += m == 0 ? "\"" : ",\"";
+        out += name(metric);
+        out += isTime(metric) ? "\":{\"unit\":\"ns\",\"count\":" : "\":{\"unit\":\"steps\",\"count\":";
+        number(h.count());
+        out += ",\"p50\":";
+        number(h.percentile(0.5));
+        out += ",\"p90\":";
+        number(h.percentile(0.9));
+        out += ",\"p99\":";
+        number(h.percentile(0.99));
+        out += ",\"max\":";
+        number(h.max());
+        out += ",\"buckets\":[";
+
+        bool first = true;
+        for (int i = 0; i < LatencyHistogram::bucketCount; i++) {
+            quint64 n = h.bucket(i);
+            if (n == 0)
+                continue;
+            out += first ? "[" : ",[";
+            number(LatencyHistogram::bucketLow(i));
+            out += ",";
+            number(LatencyHistogram::bucketHigh(i));
+            out += ",";
+            number(n);
+            out += "]";
+            first = false;
+        }
+        out += "]}";
+    }
+    out += "}\n";
+}
+
+void Instrument::clear() {
+    for (auto &h: histograms)
+        h.clear();
+    pendingInput.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,107 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <atomic>
+#include <string>
+
+#include <QtGlobal>
+
+// Counts of values in log-linear buckets: four per power of two, so any
+// percentile read back is within 25% of the truth. record() is a couple of
+// relaxed atomic adds and may run on any thread; readers see a slightly
+// stale but never torn picture.
+class LatencyHistogram {
+
+    const static int subBits = 2;
+
+public:
+    const static int bucketCount = (64 - subBits + 1) << subBits;
+
+private:
+    std::atomic<quint64> counts[bucketCount];
+    std::atomic<quint64> total, sum, maximum;
+
+public:
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    static int bucketOf(quint64 value);
+    static quint64 bucketLow(int bucket);
+    static quint64 bucketHigh(int bucket);
+
+    void record(quint64 value);
+    void clear();
+
+    quint64 count() const;
+    quint64 max() const;
+    double mean() const;
+    quint64 bucket(int i) const;
+
+    // upper end of the bucket holding the q-th quantile, q in [0, 1]
+    quint64 percentile(double q) const;
+};
+
+// Process wide histograms of the hot paths. Call sites go through the
+// SNAKE_* macros below, which compile to nothing unless SNAKE_INSTRUMENT
+// is defined (qmake CONFIG+=instrument, see common.pri).
+class Instrument {
+
+public:
+    enum Metric {
+        TickLatency,    // one step of the runner, ns
+        PaintTime,      // one SnakeBoard::paintEvent, ns
+        TicksBehind,    // steps a runner wake-up had to catch up beyond the first
+        InputLatency,   // key press to the step that consumes it, ns
+        MetricCount
+    };
+
+    static qint64 now();
+    static LatencyHistogram& histogram(Metric metric);
+    static const char* name(Metric metric);
+    static bool isTime(Metric metric);
+
+    static void markInput();
+    static void inputConsumed();
+    static void dropInput(); // a key pressed while no step was due to take it
+
+    // one line per metric with p50, p99 and max, for the overlay
+    static std::string summary(Metric metric);
+
+    // {"tickLatency": {"unit": "ns", "count": ..., "p50": ..., "p99": ...,
+    // "max": ..., "buckets": [[low, high, count], ...]}, ...}
+    static void writeJSON(std::string &out);
+
+    static void clear();
+
+    class ScopeTimer {
+        Metric metric;
+        qint64 start;
+
+    public:
+        explicit ScopeTimer(Metric _metric) : metric {_metric}, start {now()} { }
+        ~ScopeTimer() { histogram(metric).record(static_cast<quint64>(now() - start)); }
+    };
+
+private:
+    static LatencyHistogram histograms[MetricCount];
+    static std::atomic<qint64> pendingInput;
+};
+
+#ifdef SNAKE_INSTRUMENT
+#define SNAKE_TIME_SCOPE(metric) Instrument::ScopeTimer snakeScopeTimer(Instrument::metric)
+#define SNAKE_RECORD(metric, value) Instrument::histogram(Instrument::metric).record(value)
+#define SNAKE_MARK_INPUT() Instrument::markInput()
+#define SNAKE_INPUT_CONSUMED() Instrument::inputConsumed()
+#define SNAKE_DROP_INPUT() Instrument::dropInput()
+#else
+#define SNAKE_TIME_SCOPE(metric) do { } while (0)
+#define SNAKE_RECORD(metric, value) do { } while (0)
+#define SNAKE_MARK_INPUT() do { } while (0)
+#define SNAKE_INPUT_CONSUMED() do { } while (0)
+#define SNAKE_DROP_INPUT() do { } while (0)
+#endif
+
+#endif // INSTRUMENT_H
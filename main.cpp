@@ -1,11 +1,32 @@
 #include "snake.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    QCommandLineOption widthOption("width", "Board width.", "cells", "40");
+    QCommandLineOption heightOption("height", "Board height.", "cells", "40");
+    QCommandLineOption autopilotOption("autopilot", "Let the game play itself, P toggles it at runtime.");
+    parser.addOption(widthOption);
+    parser.addOption(heightOption);
+    QCommandLineOption searchOption("mcts", "Let the game play itself by tree search, M toggles it at runtime.");
+    parser.addOption(autopilotOption);
+    parser.addOption(searchOption);
+    QCommandLineOption recordOption("record", "Write a replay of the game to this file, see replay.h.", "file");
+    parser.addOption(recordOption);
+    parser.process(a);
+
     Snake w;
+    w.setBoardSize(parser.value(widthOption).toInt(), parser.value(heightOption).toInt());
+    w.setAutopilot(parser.isSet(autopilotOption) || parser.isSet(searchOption), parser.isSet(searchOption));
+    if (parser.isSet(recordOption))
+        w.setRecordFile(parser.value(recordOption));
     w.show();
     return a.exec();
 }
@@ -0,0 +1,296 @@
+#include "mctsplayer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+template <class Core>
+const int BasicMctsPlayer<Core>::nodeLimit = 1 << 18;
+template <class Core>
+const int BasicMctsPlayer<Core>::defaultRolloutDepth = 40;
+template <class Core>
+const std::int64_t BasicMctsPlayer<Core>::defaultBudgetNsecs = 10000000;
+template <class Core>
+const std::int64_t BasicMctsPlayer<Core>::rewardScale = 1 << 20;
+template <class Core>
+const double BasicMctsPlayer<Core>::exploration = 0.3;
+template <class Core>
+const double BasicMctsPlayer<Core>::discount = 0.9;
+template <class Core>
+const int BasicMctsPlayer<Core>::expandAfter = 4;
+
+static std::int64_t nowNsecs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool isReverse(int dir, Direction current) {
+    return (dir ^ 1) == static_cast<int>(current);
+}
+
+template <class Core>
+BasicMctsPlayer<Core>::BasicMctsPlayer(int threads) :
+    pool(threads),
+    nodes(new Node[nodeLimit]),
+    nodeCount {0},
+    workers(pool.size()),
+    budgetNsecs {defaultBudgetNsecs},
+    rolloutDepth {defaultRolloutDepth},
+    seed {0},
+    searches {0},
+    playouts {0},
+    searchNsecs {0} { }
+
+template <class Core>
+void BasicMctsPlayer<Core>::setTimeBudget(std::int64_t nsecs) {
+    budgetNsecs = std::max<std::int64_t>(nsecs, 0);
+}
+
+template <class Core>
+std::int64_t BasicMctsPlayer<Core>::getTimeBudget() const {
+    return budgetNsecs;
+}
+
+template <class Core>
+void BasicMctsPlayer<Core>::setRolloutDepth(int steps) {
+    rolloutDepth = std::max(steps, 1);
+}
+
+template <class Core>
+void BasicMctsPlayer<Core>::setSeed(std::uint64_t _seed) {
+    seed = _seed;
+}
+
+template <class Core>
+int BasicMctsPlayer<Core>::threadCount() const {
+    return pool.size();
+}
+
+template <class Core>
+void BasicMctsPlayer<Core>::clearNode(int node) {
+    nodes[node].visits.store(0, std::memory_order_relaxed);
+    nodes[node].children.store(Unexpanded, std::memory_order_relaxed);
+    nodes[node].value.store(0, std::memory_order_relaxed);
+}
+
+// the first child, or a negative value when another thread got here first
+// or the tree is full; the release store publishes the cleared children
+template <class Core>
+int BasicMctsPlayer<Core>::expand(int node) {
+    std::int32_t expected = Unexpanded;
+    if (!nodes[node].children.compare_exchange_strong(expected, Expanding, std::memory_order_acq_rel))
+        return -1;
+
+    int first = nodeCount.fetch_add(4, std::memory_order_relaxed);
+    if (first + 4 > nodeLimit) {
+        nodes[node].children.store(Full, std::memory_order_release);
+        return -1;
+    }
+
+    for (int dir = 0; dir < 4; dir++)
+        clearNode(first + dir);
+    nodes[node].children.store(first, std::memory_order_release);
+    return first;
+}
+
+// UCT over the children of node, an untried one first; turning back is the
+// same move as going on, so that child is left out
+template <class Core>
+int BasicMctsPlayer<Core>::select(int node, Direction current) const {
+    int children = nodes[node].children.load(std::memory_order_acquire);
+    double logVisits = std::log(std::max(1, nodes[node].visits.load(std::memory_order_relaxed)));
+
+    int best = -1;
+    double bestScore = 0;
+    for (int dir = 0; dir < 4; dir++) {
+        if (isReverse(dir, current))
+            continue;
+
+        const Node &child = nodes[children + dir];
+        int visits = child.visits.load(std::memory_order_relaxed);
+        if (visits == 0)
+            return dir;
+
+        double mean = static_cast<double>(child.value.load(std::memory_order_relaxed)) / rewardScale / visits,
+               score = mean + exploration * std::sqrt(logVisits / visits);
+        if (best < 0 || score > bestScore) {
+            best = dir;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+// after a step from the root's state, counting a bonus eaten on it
+template <class Core>
+void BasicMctsPlayer<Core>::stepTaken(Worker &worker) {
+    worker.weight *= discount;
+    int growth = worker.core.getLength() + worker.core.getPendingGrowth();
+    if (growth > worker.growth) {
+        worker.growth = growth;
+        worker.food += worker.weight;
+    }
+}
+
+// Moves that do not die right away, until rolloutDepth steps or death:
+// three times in four one that gets closer to the bonus when there is
+// such a move, any of them otherwise. Up to half for the steps survived,
+// the rest for the bonuses eaten since the root, worth less the later.
+template <class Core>
+double BasicMctsPlayer<Core>::rollout(Worker &worker) {
+    Core &core = worker.core;
+
+    int survived = 0;
+    for (; survived < rolloutDepth; survived++) {
+        Direction current = core.getDirection(), safe[4], closer[4];
+        Cell head = core.getHead(), bonus = core.getBonus();
+        int distance = std::abs(bonus.x - head.x) + std::abs(bonus.y - head.y);
+
+        int safeCount = 0, closerCount = 0;
+        for (int dir = 0; dir < 4; dir++) {
+            Cell next = head.next(static_cast<Direction>(dir));
+            if (isReverse(dir, current) || !core.inBoard(next) || core.inBody(next) || core.inBarrier(next))
+                continue;
+            safe[safeCount++] = static_cast<Direction>(dir);
+            if (std::abs(bonus.x - next.x) + std::abs(bonus.y - next.y) < distance)
+                closer[closerCount++] = static_cast<Direction>(dir);
+        }
+
+        Direction dir = current;
+        if (closerCount > 0 && worker.rng.bounded(0, 4) != 0)
+            dir = closer[worker.rng.bounded(0, closerCount)];
+        else if (safeCount > 0)
+            dir = safe[worker.rng.bounded(0, safeCount)];
+
+        worker.line.emplace_back();
+        if (!core.apply(dir, worker.line.back()))
+            break;
+        stepTaken(worker);
+    }
+
+    return 0.5 * survived / rolloutDepth + 0.5 * std::min(worker.food, 1.0);
+}
+
+// playouts on worker id until the deadline, at least one
+template <class Core>
+long long BasicMctsPlayer<Core>::search(int id, const Core &root, std::int64_t deadline) {
+    // built by the thread that searches on it
+    if (!workers[id])
+        workers[id].reset(new Worker(root));
+    else
+        workers[id] -> core = root;
+
+    Worker &worker = *workers[id];
+    Core &core = worker.core;
+    worker.rng.setState(Random(seed ^ static_cast<std::uint64_t>(root.getTime()) << 20 ^
+                               static_cast<std::uint64_t>(id)).next());
+
+    long long count = 0;
+    do {
+        worker.path.assign(1, 0);
+        worker.line.clear();
+        worker.growth = root.getLength() + root.getPendingGrowth();
+        worker.weight = 1;
+        worker.food = 0;
+        nodes[0].visits.fetch_add(1, std::memory_order_relaxed);
+
+        // down the tree to a node played out fewer than expandAfter times,
+        // or one whose children are not there yet
+        int node = 0;
+        bool dead = false;
+        for (;;) {
+            std::int32_t children = nodes[node].children.load(std::memory_order_acquire);
+            if (children == Unexpanded)
+                children = expand(node);
+            if (children < 0)
+                break;
+
+            int dir = select(node, core.getDirection());
+            node = children + dir;
+            worker.path.push_back(node);
+            int visits = nodes[node].visits.fetch_add(1, std::memory_order_relaxed);
+
+            worker.line.emplace_back();
+            if (!core.apply(static_cast<Direction>(dir), worker.line.back())) {
+                dead = true;
+                break;
+            }
+            stepTaken(worker);
+            if (visits < expandAfter)
+                break;
+        }
+
+        double reward = dead ? 0 : rollout(worker);
+        std::int64_t value = static_cast<std::int64_t>(std::llround(reward * rewardScale));
+        for (int visited: worker.path)
+            nodes[visited].value.fetch_add(value, std::memory_order_relaxed);
+
+        for (auto record = worker.line.rbegin(); record != worker.line.rend(); ++record)
+            core.unapply(*record);
+        count++;
+    } while (nowNsecs() < deadline);
+
+    return count;
+}
+
+template <class Core>
+Direction BasicMctsPlayer<Core>::next(const Core &core) {
+    assert(core.getStatus() == Core::Running);
+
+    std::int64_t start = nowNsecs(), deadline = start + budgetNsecs;
+    nodeCount.store(1, std::memory_order_relaxed);
+    clearNode(0);
+
+    std::atomic<long long> total {0};
+    pool.run(pool.size(), [&](int id, std::int64_t) {
+        total.fetch_add(search(id, core, deadline), std::memory_order_relaxed);
+    });
+
+    searches++;
+    playouts += total.load(std::memory_order_relaxed);
+    searchNsecs += nowNsecs() - start;
+
+    // the move tried most, the better one on a tie
+    Direction current = core.getDirection(), best = current;
+    int children = nodes[0].children.load(std::memory_order_acquire), bestVisits = -1;
+    std::int64_t bestValue = 0;
+    if (children < 0)
+        return best;
+
+    for (int dir = 0; dir < 4; dir++) {
+        if (isReverse(dir, current))
+            continue;
+
+        int visits = nodes[children + dir].visits.load(std::memory_order_relaxed);
+        std::int64_t value = nodes[children + dir].value.load(std::memory_order_relaxed);
+        if (visits > bestVisits || (visits == bestVisits && value > bestValue)) {
+            best = static_cast<Direction>(dir);
+            bestVisits = visits;
+            bestValue = value;
+        }
+    }
+    return best;
+}
+
+template <class Core>
+void BasicMctsPlayer<Core>::forget() { }
+
+template <class Core>
+long long BasicMctsPlayer<Core>::getSearches() const {
+    return searches;
+}
+
+template <class Core>
+long long BasicMctsPlayer<Core>::getPlayouts() const {
+    return playouts;
+}
+
+template <class Core>
+std::int64_t BasicMctsPlayer<Core>::getSearchNsecs() const {
+    return searchNsecs;
+}
+
+template class BasicMctsPlayer<SnakeCore>;
+template class BasicMctsPlayer<SnakeCore40x40>;
@@ -0,0 +1,123 @@
+#ifndef MCTSPLAYER_H
+#define MCTSPLAYER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "snakecore.h"
+#include "workpool.h"
+
+// Plays by Monte Carlo tree search: next() spends its time budget growing a
+// tree of moves from the current state, on every thread of its pool at
+// once, and picks the move tried most often. A driver like BasicAutopilot,
+// slower per step but with no plan to fall out of.
+//
+// The tree is shared by the threads without locks. Each node holds its
+// visit count, its summed rewards and the index of its four children in
+// atomics; a thread counts its visit on the way down, before the reward is
+// known, so the nodes other threads are playing out look worse for a
+// moment (a virtual loss) and they spread over the tree. The one thread
+// that swaps a node's children from unexpanded to expanding allocates and
+// fills them, the others play out from that node meanwhile.
+//
+// A node gets children once it has been played out expandAfter times, so
+// the values near the root rest on playouts rather than on a handful of
+// half explored subtrees.
+//
+// Every thread walks the tree on its own copy of the game with
+// SnakeCore::apply and unapply, then plays on at random among the moves
+// that do not kill the snake outright, mostly towards the bonus. A playout
+// is worth up to half for the steps it survives and up to half for the
+// bonuses eaten, each discounted by the steps it took to get there. The
+// random moves of thread t come from its own generator, seeded from
+// setSeed, the game time and t.
+template <class Core>
+class BasicMctsPlayer {
+
+    const static int nodeLimit;
+    const static int defaultRolloutDepth;
+    const static std::int64_t defaultBudgetNsecs;
+    const static std::int64_t rewardScale;
+    const static double exploration;
+    const static double discount;
+    const static int expandAfter;
+
+    // children values besides node indices
+    enum {Unexpanded = -1, Expanding = -2, Full = -3};
+
+    struct Node {
+        std::atomic<std::int32_t> visits;
+        std::atomic<std::int32_t> children; // the first of four, one per Direction
+        std::atomic<std::int64_t> value;    // rewards in 1/rewardScale
+    };
+
+    struct Worker {
+        Core core;
+        Random rng;
+        std::vector<SnakeCoreBase::MoveRecord> line;
+        std::vector<int> path;
+
+        // of the playout going on: length plus pending growth, what a bonus
+        // eaten on the next step is worth, the bonuses eaten so far
+        int growth;
+        double weight, food;
+
+        explicit Worker(const Core &root) : core(root), rng(0), growth {0}, weight {1}, food {0} { }
+    };
+
+    WorkPool pool;
+    std::unique_ptr<Node[]> nodes;
+    std::atomic<int> nodeCount;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::int64_t budgetNsecs;
+    int rolloutDepth;
+    std::uint64_t seed;
+
+    long long searches, playouts;
+    std::int64_t searchNsecs;
+
+    void clearNode(int node);
+    int expand(int node);
+    int select(int node, Direction current) const;
+    void stepTaken(Worker &worker);
+    double rollout(Worker &worker);
+    long long search(int id, const Core &root, std::int64_t deadline);
+
+public:
+
+    // 0 threads means one per hardware thread
+    explicit BasicMctsPlayer(int threads = 0);
+
+    BasicMctsPlayer(const BasicMctsPlayer&) = delete;
+    BasicMctsPlayer& operator=(const BasicMctsPlayer&) = delete;
+
+    // thinking time per step; a step always plays out at least once per
+    // thread, so a budget of 0 still picks a move
+    void setTimeBudget(std::int64_t nsecs);
+    std::int64_t getTimeBudget() const;
+
+    void setRolloutDepth(int steps);
+    void setSeed(std::uint64_t _seed);
+    int threadCount() const;
+
+    // the core must be Running
+    Direction next(const Core &core);
+
+    // nothing carries over between steps; here for BatchRunner
+    void forget();
+
+    // totals since construction, for playouts per second
+    long long getSearches() const;
+    long long getPlayouts() const;
+    std::int64_t getSearchNsecs() const;
+};
+
+typedef BasicMctsPlayer<SnakeCore> MctsPlayer;
+
+extern template class BasicMctsPlayer<SnakeCore>;
+extern template class BasicMctsPlayer<SnakeCore40x40>;
+
+#endif // MCTSPLAYER_H
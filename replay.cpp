@@ -0,0 +1,408 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+/*
+ * Replay layout, all integers little endian:
+ *
+ *   offset  size  field
+ *        0     4  magic "SNKR"
+ *        4     2  version
+ *        6     2  width
+ *        8     2  height
+ *       10     2  zero
+ *       12     4  step count
+ *       16     8  seed of the game at the first keyframe
+ *       24        keyframes, each a binary archive as written by toBinary
+ *                 from the game paused at that step, back to back
+ *                 runs, one byte each: the Direction in bits 0-1, the run
+ *                 length minus one in bits 2-7; a keyframe always starts a
+ *                 new run
+ *                 index, 24 bytes per keyframe in step order:
+ *                   step (4), first run after it (4), archive offset (8),
+ *                   archive size (4), status of the game (1), zero (3)
+ *   size - 16      8  index offset
+ *   size - 8       4  keyframe count
+ *   size - 4       4  magic "SNKI"
+ *
+ * The first keyframe is at step 0. Steps between two keyframes are the runs
+ * from the first one's up to the next one's.
+ */
+
+static const char replayMagic[4] = {'S', 'N', 'K', 'R'};
+static const char indexMagic[4] = {'S', 'N', 'K', 'I'};
+static const int replayVersion = 1;
+static const int replayHeaderSize = 24;
+static const int indexEntrySize = 24;
+static const int footerSize = 16;
+static const int maxRun = 64;
+
+static void put16(char *&out, int value) {
+    out[0] = static_cast<char>(value & 0xFF);
+    out[1] = static_cast<char>((value >> 8) & 0xFF);
+    out += 2;
+}
+
+static void put32(char *&out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    out += 4;
+}
+
+static void put64(char *&out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    out += 8;
+}
+
+static std::uint32_t get32(const unsigned char *&in) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= static_cast<std::uint32_t>(in[i]) << (8 * i);
+    in += 4;
+    return value;
+}
+
+static std::uint64_t get64(const unsigned char *&in) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+    in += 8;
+    return value;
+}
+
+template <class Core>
+const int BasicReplayRecorder<Core>::keyframeInterval = 1024;
+template <class Core>
+const int BasicReplayRecorder<Core>::cellLimit = 1024 * 1024;
+template <class Core>
+const qint64 BasicReplayRecorder<Core>::byteLimit = 256ll << 20;
+
+template <class Core>
+BasicReplayRecorder<Core>::BasicReplayRecorder() :
+    ticks {0},
+    interval {keyframeInterval},
+    width {0},
+    height {0},
+    runOpen {false},
+    full {false},
+    bytes {0},
+    seed {0} { }
+
+template <class Core>
+void BasicReplayRecorder<Core>::clear() {
+    runs.clear();
+    keyframes.clear();
+    ticks = 0;
+    runOpen = false;
+    full = false;
+    bytes = 0;
+    scratch.reset();
+}
+
+template <class Core>
+bool BasicReplayRecorder<Core>::isEmpty() const {
+    return keyframes.empty();
+}
+
+template <class Core>
+bool BasicReplayRecorder<Core>::isFull() const {
+    return full;
+}
+
+template <class Core>
+int BasicReplayRecorder<Core>::getTicks() const {
+    return ticks;
+}
+
+template <class Core>
+void BasicReplayRecorder<Core>::keyframe(const Core &core) {
+    if (full)
+        return;
+    if (static_cast<qint64>(core.getWidth()) * core.getHeight() > cellLimit) {
+        full = true;
+        return;
+    }
+
+    if (keyframes.empty()) {
+        seed = core.getSeed();
+        width = core.getWidth();
+        height = core.getHeight();
+        interval = std::max(keyframeInterval, core.getWidth() * core.getHeight() / 4);
+    }
+
+    if (!scratch)
+        scratch.reset(new Core(core));
+    else
+        *scratch = core;
+    if (scratch -> getStatus() != Core::Pause)
+        scratch -> pause();
+
+    QByteArray archive = scratch -> toBinary();
+    bool replace = !keyframes.empty() && keyframes.back().tick == ticks;
+    qint64 grown = bytes + archive.size() - (replace ? keyframes.back().archive.size() : 0);
+    if (grown > byteLimit) {
+        full = true;
+        return;
+    }
+
+    if (!replace)
+        keyframes.push_back(Keyframe());
+
+    Keyframe &last = keyframes.back();
+    last.tick = ticks;
+    last.runOffset = static_cast<int>(runs.size());
+    last.status = core.getStatus();
+    last.archive = archive;
+    bytes = grown;
+    runOpen = false;
+}
+
+template <class Core>
+void BasicReplayRecorder<Core>::record(const Core &core) {
+    if (full)
+        return;
+    assert(!keyframes.empty());
+
+    int dir = static_cast<int>(core.getDirection());
+    if (runOpen && (runs.back() & 3) == dir && (runs.back() >> 2) < maxRun - 1) {
+        runs.back() = static_cast<unsigned char>(runs.back() + 4);
+    } else if (bytes < byteLimit) {
+        runs.push_back(static_cast<unsigned char>(dir));
+        bytes++;
+    } else {
+        full = true;
+        return;
+    }
+    runOpen = true;
+    ticks++;
+
+    if (ticks - keyframes.back().tick >= interval && core.getStatus() == Core::Running)
+        keyframe(core);
+}
+
+template <class Core>
+QByteArray BasicReplayRecorder<Core>::toReplay() const {
+    if (keyframes.empty())
+        return QByteArray();
+
+    qint64 archives = 0;
+    for (const Keyframe &frame: keyframes)
+        archives += frame.archive.size();
+    qint64 runsOffset = replayHeaderSize + archives,
+           indexOffset = runsOffset + static_cast<qint64>(runs.size()),
+           size = indexOffset + indexEntrySize * static_cast<qint64>(keyframes.size()) + footerSize;
+    if (size > INT_MAX)
+        return QByteArray();
+
+    QByteArray replay(static_cast<int>(size), '\0');
+    char *out = replay.data();
+
+    for (char c: replayMagic)
+        *out++ = c;
+    put16(out, replayVersion);
+    put16(out, width);
+    put16(out, height);
+    put16(out, 0);
+    put32(out, static_cast<std::uint32_t>(ticks));
+    put64(out, seed);
+
+    for (const Keyframe &frame: keyframes)
+        out = std::copy(frame.archive.constData(), frame.archive.constData() + frame.archive.size(), out);
+    out = std::copy(runs.begin(), runs.end(), out);
+
+    qint64 offset = replayHeaderSize;
+    for (const Keyframe &frame: keyframes) {
+        put32(out, static_cast<std::uint32_t>(frame.tick));
+        put32(out, static_cast<std::uint32_t>(frame.runOffset));
+        put64(out, static_cast<std::uint64_t>(offset));
+        put32(out, static_cast<std::uint32_t>(frame.archive.size()));
+        *out++ = static_cast<char>(frame.status);
+        out += 3;
+        offset += frame.archive.size();
+    }
+
+    put64(out, static_cast<std::uint64_t>(indexOffset));
+    put32(out, static_cast<std::uint32_t>(keyframes.size()));
+    for (char c: indexMagic)
+        *out++ = c;
+
+    return replay;
+}
+
+template <class Core>
+BasicReplayPlayer<Core>::BasicReplayPlayer() :
+    runs {nullptr},
+    runCount {0},
+    ticks {0},
+    seed {0},
+    tick {0},
+    base {-1},
+    run {0},
+    taken {0} { }
+
+template <class Core>
+bool BasicReplayPlayer<Core>::isReplay(const char *data, qint64 size) {
+    return size >= 4 && std::equal(replayMagic, replayMagic + 4, data);
+}
+
+// Checks everything seek relies on up front: the keyframes lie inside the
+// file before the runs, and the runs between two keyframes add up to the
+// steps between them. The archives themselves are only read by seek.
+template <class Core>
+BasicReplayPlayer<Core>* BasicReplayPlayer<Core>::open(const char *data, qint64 size) {
+    if (size < replayHeaderSize + footerSize || !isReplay(data, size) ||
+        !std::equal(indexMagic, indexMagic + 4, data + size - 4))
+        return nullptr;
+
+    const unsigned char *in = reinterpret_cast<const unsigned char*>(data) + 4;
+    int version = in[0] | (in[1] << 8);
+    in += 8;
+    std::uint32_t _ticks = get32(in);
+    std::uint64_t _seed = get64(in);
+
+    in = reinterpret_cast<const unsigned char*>(data) + size - footerSize;
+    std::uint64_t indexOffset = get64(in);
+    std::uint32_t count = get32(in);
+
+    if (version != replayVersion || _ticks > 0x7FFFFFFF || count == 0 ||
+        indexOffset < replayHeaderSize || indexOffset > static_cast<std::uint64_t>(size) ||
+        indexOffset + static_cast<std::uint64_t>(count) * indexEntrySize + footerSize != static_cast<std::uint64_t>(size))
+        return nullptr;
+
+    std::unique_ptr<BasicReplayPlayer> player(new BasicReplayPlayer());
+    player -> ticks = static_cast<int>(_ticks);
+    player -> seed = _seed;
+    player -> keyframes.resize(count);
+
+    in = reinterpret_cast<const unsigned char*>(data) + indexOffset;
+    qint64 archivesEnd = replayHeaderSize;
+    for (std::uint32_t i = 0; i < count; i++) {
+        Keyframe &frame = player -> keyframes[i];
+        std::uint32_t _tick = get32(in), runOffset = get32(in);
+        std::uint64_t offset = get64(in);
+        std::uint32_t archiveSize = get32(in);
+        int status = *in;
+        in += 4;
+
+        if (_tick > _ticks || (i == 0 ? _tick != 0 : _tick <= static_cast<std::uint32_t>(player -> keyframes[i - 1].tick)) ||
+            runOffset > 0x7FFFFFFF || offset != static_cast<std::uint64_t>(archivesEnd) ||
+            status > Core::Over)
+            return nullptr;
+
+        frame.tick = static_cast<int>(_tick);
+        frame.runOffset = static_cast<int>(runOffset);
+        frame.status = static_cast<typename Core::GameStatus>(status);
+        frame.offset = archivesEnd;
+        frame.size = archiveSize;
+        archivesEnd += archiveSize;
+        if (archivesEnd > static_cast<qint64>(indexOffset))
+            return nullptr;
+    }
+
+    player -> runCount = static_cast<int>(static_cast<qint64>(indexOffset) - archivesEnd);
+    const unsigned char *runs = reinterpret_cast<const unsigned char*>(data) + archivesEnd;
+
+    std::uint64_t steps = 0;
+    std::uint32_t next = 0;
+    for (int i = 0; i <= player -> runCount; i++) {
+        for (; next < count && player -> keyframes[next].runOffset == i; next++)
+            if (steps != static_cast<std::uint64_t>(player -> keyframes[next].tick))
+                return nullptr;
+        if (i < player -> runCount)
+            steps += (runs[i] >> 2) + 1;
+    }
+    if (next != count || steps != _ticks)
+        return nullptr;
+
+    player -> replay = QByteArray(data, static_cast<int>(size));
+    player -> runs = reinterpret_cast<const unsigned char*>(player -> replay.constData()) + archivesEnd;
+    if (!player -> seek(0))
+        return nullptr;
+    return player.release();
+}
+
+template <class Core>
+bool BasicReplayPlayer<Core>::load(int keyframe) {
+    const Keyframe &frame = keyframes[keyframe];
+    Core *loaded = Core::fromBinary(replay.constData() + frame.offset, frame.size);
+    if (loaded == nullptr)
+        return false;
+
+    // the steps after a keyframe were played, whatever it was saved as
+    if (frame.status == Core::Over)
+        loaded -> over();
+    else
+        loaded -> continuee();
+
+    core.reset(loaded);
+    tick = frame.tick;
+    base = keyframe;
+    run = frame.runOffset;
+    taken = 0;
+    return true;
+}
+
+template <class Core>
+bool BasicReplayPlayer<Core>::seek(int _tick) {
+    _tick = std::max(0, std::min(_tick, ticks));
+
+    // the last keyframe at or before _tick; moving on from where the game
+    // is only works from that one, a later keyframe may follow an edit
+    int keyframe = static_cast<int>(std::upper_bound(keyframes.begin(), keyframes.end(), _tick,
+                                                     [](int at, const Keyframe &frame) {
+                                                         return at < frame.tick;
+                                                     }) - keyframes.begin()) - 1;
+    if (keyframe != base || tick > _tick) {
+        if (!load(keyframe))
+            return false;
+    }
+
+    typename Core::MoveRecord record;
+    while (tick < _tick) {
+        Direction dir = static_cast<Direction>(runs[run] & 3);
+        int steps = std::min((runs[run] >> 2) + 1 - taken, _tick - tick);
+        for (int i = 0; i < steps && core -> getStatus() == Core::Running; i++)
+            core -> apply(dir, record);
+
+        tick += steps;
+        taken += steps;
+        if (taken > runs[run] >> 2) {
+            run++;
+            taken = 0;
+        }
+    }
+    return true;
+}
+
+template <class Core>
+bool BasicReplayPlayer<Core>::step() {
+    return tick < ticks && seek(tick + 1);
+}
+
+template <class Core>
+int BasicReplayPlayer<Core>::getTicks() const {
+    return ticks;
+}
+
+template <class Core>
+int BasicReplayPlayer<Core>::getTick() const {
+    return tick;
+}
+
+template <class Core>
+std::uint64_t BasicReplayPlayer<Core>::getSeed() const {
+    return seed;
+}
+
+template <class Core>
+const Core& BasicReplayPlayer<Core>::getCore() const {
+    return *core;
+}
+
+template class BasicReplayRecorder<SnakeCore>;
+template class BasicReplayRecorder<SnakeCore40x40>;
+template class BasicReplayPlayer<SnakeCore>;
+template class BasicReplayPlayer<SnakeCore40x40>;
@@ -0,0 +1,123 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+
+#include "snakecore.h"
+
+// Records a game as the direction each step took, to be played back step
+// for step later; see replay.cpp for the file layout.
+//
+// A step costs one byte at most: runs of up to 64 steps in one direction
+// share a byte, the direction in the low 2 bits and the run length above.
+// Every keyframeInterval steps, or every cells / 4 steps on larger boards
+// where an archive takes more bytes, the whole game is kept as a binary
+// archive, so playback never re-simulates more than that from the nearest
+// keyframe. Taking one costs a copy of the core and toBinary, a few
+// microseconds on a 40x40 board.
+//
+// Boards of more than cellLimit cells are not recorded, a keyframe of one
+// would take megabytes and stall the step that takes it. A replay stops
+// growing at byteLimit bytes, the steps after that are left out.
+template <class Core>
+class BasicReplayRecorder {
+
+    const static int keyframeInterval;
+    const static int cellLimit;
+    const static qint64 byteLimit;
+
+    struct Keyframe {
+        int tick, runOffset;
+        typename Core::GameStatus status;
+        QByteArray archive;
+    };
+
+    std::vector<unsigned char> runs;
+    std::vector<Keyframe> keyframes;
+    int ticks, interval, width, height;
+    bool runOpen; // the last byte of runs may take more steps
+    bool full;    // over one of the limits, nothing more is kept
+    qint64 bytes;
+    std::uint64_t seed;
+
+    // a paused copy to write the keyframes from, kept for its storage
+    std::unique_ptr<Core> scratch;
+
+public:
+
+    BasicReplayRecorder();
+
+    void clear();
+    bool isEmpty() const;
+    bool isFull() const;
+    int getTicks() const;
+
+    // The game as it is now; the first keyframe starts the replay. Take one
+    // whenever the game changed other than by moving, such as barriers
+    // edited while paused. Replaces a keyframe taken at the same step.
+    void keyframe(const Core &core);
+
+    // after every move, dead or alive; a keyframe now and then
+    void record(const Core &core);
+
+    // empty when nothing was recorded
+    QByteArray toReplay() const;
+};
+
+// Plays a replay back: seek puts the game at any step by loading the
+// nearest keyframe at or before it and moving on from there, or moving on
+// from where it is when that is closer. A step costs about what apply does.
+template <class Core>
+class BasicReplayPlayer {
+
+    struct Keyframe {
+        int tick, runOffset;
+        typename Core::GameStatus status;
+        qint64 offset, size;
+    };
+
+    QByteArray replay;
+    std::vector<Keyframe> keyframes;
+    const unsigned char *runs;
+    int runCount, ticks;
+    std::uint64_t seed;
+
+    // where the game is: its step, the keyframe it comes from, the next run
+    // and how many of its steps are taken
+    std::unique_ptr<Core> core;
+    int tick, base, run, taken;
+
+    BasicReplayPlayer();
+    bool load(int keyframe);
+
+public:
+
+    // nullptr when data is not a well formed replay; data is copied
+    static BasicReplayPlayer* open(const char *data, qint64 size);
+    static bool isReplay(const char *data, qint64 size);
+
+    int getTicks() const;
+    int getTick() const;
+    std::uint64_t getSeed() const;
+
+    // clamped to [0, getTicks()]; false when a keyframe fails to load, the
+    // game is then where it was
+    bool seek(int _tick);
+    bool step();
+
+    const Core& getCore() const;
+};
+
+typedef BasicReplayRecorder<SnakeCore> ReplayRecorder;
+typedef BasicReplayPlayer<SnakeCore> ReplayPlayer;
+
+extern template class BasicReplayRecorder<SnakeCore>;
+extern template class BasicReplayRecorder<SnakeCore40x40>;
+extern template class BasicReplayPlayer<SnakeCore>;
+extern template class BasicReplayPlayer<SnakeCore40x40>;
+
+#endif // REPLAY_H
@@ -1,16 +1,20 @@
 #include "snake.h"
 #include "ui_snake.h"
+#include "replay.h"
 
 #include <iostream>
-#include <QDebug>
+#include <memory>
 #include <QMessageBox>
 #include <QTimer>
 #include <QKeyEvent>
 #include <QFileDialog>
-#include <QJsonDocument>
+#include <QFile>
 #include <QToolBar>
 
-int Snake::timePerStep = 100;
+const int Snake::defaultSpeed = 10;
+const int Snake::timePerFrame = 16;
+const int Snake::minBoardSide = 10;
+const int Snake::maxBoardSide = 4096;
 
 const bool Snake::isButtonEnable[4][6] = {
     /* Origin */ {true, false, false, true, true, false},
@@ -22,11 +26,12 @@ const bool Snake::isButtonEnable[4][6] = {
 Snake::Snake(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::Snake),
-	  timer_move(new QTimer()) {
+	  timer_frame(new QTimer()) {
 
     ui -> setupUi(this);
 
 	core = ui -> board -> getCore();
+	ui -> board -> setRunner(&runner);
 
     connect(ui -> startButton, SIGNAL(clicked()),
             this, SLOT(start()));
@@ -43,12 +48,13 @@ Snake::Snake(QWidget *parent)
     connect(ui -> speedSpinBox, SIGNAL(valueChanged(int)),
             this, SLOT(updateSpeed()));
 
-    connect(timer_move, SIGNAL(timeout()),
-            this, SLOT(move()));
+    connect(timer_frame, SIGNAL(timeout()),
+            this, SLOT(nextFrame()));
 
-	timer_move -> setInterval(timePerStep);
+	timer_frame -> setInterval(timePerFrame);
 
-    ui -> speedSpinBox -> setValue( 1000 / timePerStep );
+    ui -> speedSpinBox -> setValue( defaultSpeed );
+    changeSpeed( defaultSpeed );
 
     updateButton();
 }
@@ -58,68 +64,158 @@ void Snake::updateSpeed() {
 }
 
 Snake::~Snake() {
+    runner.stop();
+    writeReplay();
     delete ui;
 }
 
+void Snake::setRecordFile(const QString &filename) {
+    recordFile = filename;
+    runner.setRecording(filename.length() > 0);
+}
+
+// quietly, it also runs on the way out
+void Snake::writeReplay() {
+    if (recordFile.length() == 0)
+        return;
+
+    QByteArray replay = runner.toReplay();
+    QFile io(recordFile);
+    if (replay.size() > 0 && io.open(QIODevice::WriteOnly)) {
+        io.write(replay);
+        io.close();
+    }
+}
+
+void Snake::setBoardSize(int width, int height) {
+    runner.stop();
+    timer_frame -> stop();
+
+    core = ui -> board -> setBoardSize(qBound(minBoardSide, width, maxBoardSide),
+                                       qBound(minBoardSide, height, maxBoardSide));
+    showFrame();
+    updateButton();
+}
+
 void Snake::start() {
     core -> start();
-    timer_move -> start();
-
     updateButton();
+
+    runner.publish();
+    runner.start();
+    timer_frame -> start();
+}
+
+void Snake::setAutopilot(bool on, bool search) {
+    if (on)
+        runner.setSearch(search);
+    runner.setAutopilot(on);
+}
+
+// any direction key takes the game back from the autopilot
+void Snake::steer(Direction direction) {
+    SNAKE_MARK_INPUT();
+    runner.setAutopilot(false);
+    core -> changeDirection(direction);
 }
 
 void Snake::keyPressEvent(QKeyEvent *event) {
     switch (event -> key()) {
         case Qt::Key_A:
         case Qt::Key_Left:
-            core -> changeDirection(Left);
+            steer(Left);
             break;
         case Qt::Key_W:
         case Qt::Key_Up:
-            core -> changeDirection(Up);
+            steer(Up);
             break;
         case Qt::Key_S:
         case Qt::Key_Down:
-            core -> changeDirection(Down);
+            steer(Down);
             break;
         case Qt::Key_D:
         case Qt::Key_Right:
-            core -> changeDirection(Right);
+            steer(Right);
+            break;
+        case Qt::Key_F:
+            ui -> board -> followHead();
+            break;
+        case Qt::Key_P:
+            setAutopilot(!runner.hasAutopilot() || runner.hasSearch());
+            break;
+        case Qt::Key_M:
+            setAutopilot(!runner.hasAutopilot() || !runner.hasSearch(), true);
+            break;
+        case Qt::Key_R:
+            runner.setRecording(!runner.isRecording());
+            break;
+#ifdef SNAKE_INSTRUMENT
+        case Qt::Key_F3:
+            ui -> board -> toggleOverlay();
+            break;
+        case Qt::Key_F4:
+            exportStats();
             break;
+#endif
         default:
-            qDebug() << "unvaild key";
+            QMainWindow::keyPressEvent(event);
     }
 }
 
-void Snake::move() {
-	if (!core -> move()) {
-        timer_move -> stop();
-        QMessageBox::information(this, tr("Sorry"), tr("You are dead."));
-		updateButton();
-	}
+// The game itself runs on the runner's thread; the window only picks up the
+// latest snapshot once per frame, so a slow paint or an open dialog never
+// holds back a step.
+void Snake::nextFrame() {
+    bool finished = !runner.isRunning();
 
-    ui -> scoreLCD -> display(core -> getScore());
-    ui -> timeLCD -> display(core -> getTime());
-	ui -> board -> repaint();
+    showFrame();
+    if (!finished)
+        return;
+
+    // the snake died, the core is ours again
+    timer_frame -> stop();
+    runner.stop();
+    writeReplay();
+    updateButton();
+    QMessageBox::information(this, tr("Sorry"), tr("You are dead."));
+}
+
+void Snake::showFrame() {
+    ui -> board -> refresh();
+    ui -> scoreLCD -> display(ui -> board -> getView().score);
+    ui -> timeLCD -> display(ui -> board -> getView().time);
 }
 
 void Snake::pause() {
 
-    if (core -> getStatus() == SnakeCore::Running) {
-        timer_move -> stop();
+    if (runner.isRunning()) {
+        timer_frame -> stop();
+        runner.stop();
+
+        // the snake may have died before the click got here
+        if (core -> getStatus() != SnakeCore::Running) {
+            nextFrame();
+            return;
+        }
+
         core -> pause();
+        showFrame();
+        updateButton();
     } else if (core -> getStatus() == SnakeCore::Pause) {
-        timer_move -> start();
         core -> continuee();
-    }
+        updateButton();
 
-    updateButton();
+        runner.publish();
+        runner.start();
+        timer_frame -> start();
+    }
 }
 
 void Snake::restart() {
     assert(core -> getStatus() == SnakeCore::Pause ||
            core -> getStatus() == SnakeCore::Over);
 
+    writeReplay();
     core = ui -> board -> newCore();
     start();
 }
@@ -159,66 +255,119 @@ void Snake::updateButton() {
 }
 
 void Snake::changeSpeed(int speed) {
-    timePerStep = 1000 / speed;
-    timer_move -> setInterval(timePerStep);
+    runner.setSpeed(speed);
 }
 
 void Snake::save() {
     assert(core -> getStatus() == SnakeCore::Pause);
 
-    QString json = core -> toJSON();
-    QString filename = QFileDialog::getSaveFileName(this, tr("Save As"));
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save As"), QString(),
+                                                    tr("JSON archive (*.json);;Binary archive (*.snkb);;Replay (*.snkr);;All files (*)"));
+
+    if (filename.length() == 0)
+        return;
+
+    bool replaying = filename.endsWith(".snkr", Qt::CaseInsensitive);
+    QByteArray replay = replaying ? runner.toReplay() : QByteArray();
+    if (replaying && replay.size() == 0) {
+        QMessageBox::warning(this, tr("Nothing recorded"),
+                             tr("Press R, or start with --record, and the game is recorded from the next start."));
+        return;
+    }
 
     QFile io(filename);
 
-    if (!io.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    if (!io.open(QIODevice::WriteOnly)) {
         QMessageBox::warning(this, tr("Can not open file"), tr("Sorry, we can not open %1 .").arg(filename));
         return;
     }
 
-    QTextStream stream(&io);
-    stream << json;
+    if (filename.endsWith(".snkb", Qt::CaseInsensitive)) {
+        io.write(core -> toBinary());
+    } else if (replaying) {
+        io.write(replay);
+    } else {
+        std::string json;
+        core -> writeJSON(json);
+        io.write(json.data(), static_cast<qint64>(json.size()));
+    }
 
     io.close();
 }
 
+#ifdef SNAKE_INSTRUMENT
+// the histograms keep filling while the dialog is open, the file holds them
+// as they were when it closed
+void Snake::exportStats() {
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export Timings"), QString(),
+                                                    tr("JSON (*.json);;All files (*)"));
+
+    if (filename.length() == 0)
+        return;
+
+    QFile io(filename);
+
+    if (!io.open(QIODevice::WriteOnly)) {
+        QMessageBox::warning(this, tr("Can not open file"), tr("Sorry, we can not open %1 .").arg(filename));
+        return;
+    }
+
+    std::string json;
+    Instrument::writeJSON(json);
+    io.write(json.data(), static_cast<qint64>(json.size()));
+    io.close();
+}
+#endif
+
 void Snake::load() {
     assert(core -> getStatus() != SnakeCore::Running);
 
-    QString filename = QFileDialog::getOpenFileName(this, tr("Load From"));
+    QString filename = QFileDialog::getOpenFileName(this, tr("Load From"), QString(),
+                                                    tr("Snake archives (*.json *.snkb *.snkr);;All files (*)"));
 
     if (filename.length() == 0)
         return;
 
     QFile io(filename);
-    if (!io.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!io.open(QIODevice::ReadOnly)) {
         QMessageBox::warning(this, tr("Can not open file"), tr("Sorry, we can not open %1 .").arg(filename));
         return;
     }
 
-    QTextStream stream(&io);
-    QString json = stream.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(json.toUtf8());
-
-    if (doc.isNull()) {
-        QMessageBox::warning(this, tr("Can not load archive"), tr("Null Archive file"));
-        return;
+    // map the whole archive when we can, otherwise fall back to one read
+    QByteArray data;
+    uchar *mapped = io.size() > 0 ? io.map(0, io.size()) : nullptr;
+    if (mapped != nullptr)
+        data = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), static_cast<int>(io.size()));
+    else
+        data = io.readAll();
+
+    SnakeCore *loaded = nullptr;
+    if (ReplayPlayer::isReplay(data.constData(), data.size())) {
+        // a replay opens at its last step
+        std::unique_ptr<ReplayPlayer> player(ReplayPlayer::open(data.constData(), data.size()));
+        if (player && player -> seek(player -> getTicks())) {
+            loaded = new SnakeCore(player -> getCore());
+            if (loaded -> getStatus() == SnakeCore::Running)
+                loaded -> pause();
+        }
+    } else if (SnakeCore::isBinaryArchive(data.constData(), data.size())) {
+        loaded = SnakeCore::fromBinary(data.constData(), data.size());
+    } else {
+        loaded = SnakeCore::fromJSON(data.constData(), data.size());
     }
 
-    if (!doc.isObject()) {
+    if (loaded == nullptr) {
         QMessageBox::warning(this, tr("Can not load archive"), tr("Invaild Archive format"));
         return;
     }
 
-    qDebug() << "json parse done";
-
     if (core != nullptr)
         delete core;
 
-    core = new SnakeCore(doc.object());
+    core = loaded;
     ui -> board -> replaceCore(core);
-    ui -> scoreLCD -> display(core -> getScore());
-    ui -> timeLCD -> display(core -> getTime());
+    showFrame();
     updateButton();
 }
 
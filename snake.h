@@ -5,7 +5,9 @@
 #include <QGraphicsScene>
 #include <QPainter>
 
+#include "instrument.h"
 #include "snakecore.h"
+#include "snakerunner.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class Snake; }
@@ -18,24 +20,44 @@ public:
     Snake(QWidget *parent = nullptr);
     ~Snake();
 
+    // clamped to [minBoardSide, maxBoardSide], starts over from Origin
+    void setBoardSize(int width, int height);
+
+    // lets the game play itself, see Autopilot, or MctsPlayer with search
+    void setAutopilot(bool on, bool search = false);
+
+    // records every game and writes its replay here when it ends, is
+    // restarted or the window closes; the latest game wins
+    void setRecordFile(const QString &filename);
+
 private:
 
     enum ButtonIdx {b_start = 0, b_pause, b_restart, b_load, b_exit, b_save};
     const static bool isButtonEnable[4][6];
-	static int timePerStep;
+	const static int defaultSpeed;
+	const static int timePerFrame;
+	const static int minBoardSide, maxBoardSide;
 
     Ui::Snake *ui;
-	QTimer *timer_move;
+	QTimer *timer_frame;
 	SnakeCore *core;
+	SnakeRunner runner;
+	QString recordFile;
 
     void keyPressEvent(QKeyEvent *event);
+    void steer(Direction direction);
 	void changeSpeed(int speed);
 	void updateButton();
+	void showFrame();
+	void writeReplay();
+#ifdef SNAKE_INSTRUMENT
+    void exportStats();
+#endif
 
 private slots:
 
     void start();
-    void move();
+    void nextFrame();
     void pause();
     void restart();
     void save();
@@ -0,0 +1,20 @@
+# Builds the core library first, then the programs linking against it.
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    snakecore \
+    snakesim \
+    snakebench \
+    snakecheck \
+    snake
+
+snakecore.file = snakecore.pro
+snakesim.file = snakesim.pro
+snakesim.depends = snakecore
+snakebench.file = snakebench.pro
+snakebench.depends = snakecore
+snakecheck.file = snakecheck.pro
+snakecheck.depends = snakecore
+snake.file = snake.pro
+snake.depends = snakecore
@@ -0,0 +1,611 @@
+#include "snakecore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Binary archive layout, all integers little endian:
+ *
+ *   offset  size  field
+ *        0     4  magic "SNKB"
+ *        4     2  version
+ *        6     2  width
+ *        8     2  height
+ *       10     1  status
+ *       11     1  direction
+ *       12     4  timeFromStart
+ *       16     4  bonusCnt
+ *       20     8  seed
+ *       28     8  rngState
+ *       36     4  bonus x, y (signed 16 bit each, -1 when there is none)
+ *       40     4  barrier count
+ *       44     4  body length
+ *       48        barriers, 16 bit x and y each
+ *                 head, 16 bit x and y (the body has at least one segment)
+ *                 one 2 bit Direction per remaining segment, pointing from
+ *                 the previous segment to it, packed four per byte from the
+ *                 lowest bits up
+ *                 free cell count (4 bytes), then every free cell index in
+ *                 the order of the free-cell set, 16 bit when the board has
+ *                 at most 65536 cells and 32 bit otherwise; bonuses are drawn
+ *                 by position in that set, so keeping the order keeps a
+ *                 reloaded game identical to the saved one
+ */
+
+static const char binaryMagic[4] = {'S', 'N', 'K', 'B'};
+static const int binaryVersion = 1;
+static const int binaryHeaderSize = 48;
+
+static void put16(char *&out, int value) {
+    out[0] = static_cast<char>(value & 0xFF);
+    out[1] = static_cast<char>((value >> 8) & 0xFF);
+    out += 2;
+}
+
+static void put32(char *&out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    out += 4;
+}
+
+static void put64(char *&out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    out += 8;
+}
+
+static int get16(const unsigned char *&in) {
+    int value = in[0] | (in[1] << 8);
+    in += 2;
+    return value;
+}
+
+static int getSigned16(const unsigned char *&in) {
+    return static_cast<std::int16_t>(get16(in));
+}
+
+static std::uint32_t get32(const unsigned char *&in) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= static_cast<std::uint32_t>(in[i]) << (8 * i);
+    in += 4;
+    return value;
+}
+
+static std::uint64_t get64(const unsigned char *&in) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+    in += 8;
+    return value;
+}
+
+// A body of at least one segment, each next to the one before and none on
+// a cell twice or on a barrier, barriers on distinct cells, and the bonus
+// on a free cell or nowhere. Anything else breaks the free cell bookkeeping
+// on the first move, or toBinary on the next save.
+template <class Board>
+bool BasicSnakeCore<Board>::isPlayable() const {
+    if (length < 1)
+        return false;
+
+    for (int i = 1; i < length; i++) {
+        Cell previous = bodyAt(i - 1), chunk = bodyAt(i);
+        if (std::abs(previous.x - chunk.x) + std::abs(previous.y - chunk.y) != 1)
+            return false;
+    }
+
+    int bodyCells = 0, barrierCells = 0;
+    for (unsigned char flags: grid) {
+        if ((flags & BodyCell) && (flags & BarrierCell))
+            return false;
+        bodyCells += (flags & BodyCell) != 0;
+        barrierCells += (flags & BarrierCell) != 0;
+    }
+    if (bodyCells != length || barrierCells != static_cast<int>(barriers -> size()))
+        return false;
+
+    return bonus == Cell(-1, -1) || (inBoard(bonus) && grid[cellIndex(bonus)] == EmptyCell);
+}
+
+template <class Board>
+QByteArray BasicSnakeCore<Board>::toBinary() const {
+    assert(status == Pause);
+
+    int barrierCount = static_cast<int>(barriers -> size());
+    int freeCount = static_cast<int>(freeCells.size());
+    int cellSize = this -> cells() <= 0x10000 ? 2 : 4;
+    int size = binaryHeaderSize + 4 * barrierCount;
+    if (length > 0)
+        size += 4 + (length - 1 + 3) / 4;
+    size += 4 + cellSize * freeCount;
+
+    QByteArray archive(size, '\0');
+    char *out = archive.data();
+
+    for (char c: binaryMagic)
+        *out++ = c;
+    put16(out, binaryVersion);
+    put16(out, getWidth());
+    put16(out, getHeight());
+    *out++ = static_cast<char>(status);
+    *out++ = static_cast<char>(direction);
+    put32(out, timeFromStart);
+    put32(out, bonusCnt);
+    put64(out, seed);
+    put64(out, rng.getState());
+    put16(out, bonus.x);
+    put16(out, bonus.y);
+    put32(out, barrierCount);
+    put32(out, length);
+
+    for (auto &chunk: *barriers) {
+        put16(out, chunk.x);
+        put16(out, chunk.y);
+    }
+
+    if (length > 0) {
+        put16(out, bodyAt(0).x);
+        put16(out, bodyAt(0).y);
+
+        unsigned char *packed = reinterpret_cast<unsigned char*>(out);
+        for (int i = 1; i < length; i++) {
+            int dir = static_cast<int>(bodyAt(i - 1).calcDirection(bodyAt(i)));
+            packed[(i - 1) / 4] |= static_cast<unsigned char>(dir << (2 * ((i - 1) % 4)));
+        }
+        out += (length - 1 + 3) / 4;
+    }
+
+    put32(out, freeCount);
+    for (int cell: freeCells) {
+        if (cellSize == 2)
+            put16(out, cell);
+        else
+            put32(out, cell);
+    }
+
+    return archive;
+}
+
+template <class Board>
+bool BasicSnakeCore<Board>::isBinaryArchive(const char *data, qint64 size) {
+    return size >= 4 && std::equal(binaryMagic, binaryMagic + 4, data);
+}
+
+template <class Board>
+BasicSnakeCore<Board>* BasicSnakeCore<Board>::fromBinary(const char *data, qint64 size) {
+    if (size < binaryHeaderSize || !isBinaryArchive(data, size))
+        return nullptr;
+
+    const unsigned char *in = reinterpret_cast<const unsigned char*>(data) + 4;
+
+    int version = get16(in);
+    int _width = get16(in), _height = get16(in);
+    int _status = *in++, _direction = *in++;
+    std::uint32_t _timeFromStart = get32(in), _bonusCnt = get32(in);
+    std::uint64_t _seed = get64(in), rngState = get64(in);
+    int bonusX = getSigned16(in), bonusY = getSigned16(in);
+    std::uint32_t barrierCount = get32(in), bodyLength = get32(in);
+
+    qint64 cells = static_cast<qint64>(_width) * _height;
+    if (version != binaryVersion || !Board::fits(_width, _height) ||
+        _status > Over || _direction > Down || bodyLength == 0 ||
+        _timeFromStart > INT_MAX || _bonusCnt > INT_MAX ||
+        static_cast<qint64>(barrierCount) + bodyLength > cells)
+        return nullptr;
+
+    // every cell is in the file as barrier, segment or free cell, so the
+    // size vouches for the board before any of it is allocated
+    int cellSize = cells <= 0x10000 ? 2 : 4;
+    qint64 expected = binaryHeaderSize + 4 * static_cast<qint64>(barrierCount) + 4 + (bodyLength - 1 + 3) / 4;
+    if (size < expected + 4 + cellSize * (cells - barrierCount - bodyLength))
+        return nullptr;
+
+    BasicSnakeCore *core = new BasicSnakeCore(_width, _height, _seed, static_cast<GameStatus>(_status));
+    core -> direction = static_cast<Direction>(_direction);
+    core -> timeFromStart = static_cast<int>(_timeFromStart);
+    core -> bonusCnt = static_cast<int>(_bonusCnt);
+    core -> bonus = Cell(bonusX, bonusY);
+    core -> rng.setState(rngState);
+
+    bool valid = true;
+
+    core -> barriers -> reserve(barrierCount);
+    for (std::uint32_t i = 0; i < barrierCount; i++) {
+        int x = get16(in), y = get16(in);
+        core -> barriers -> push_back(Cell(x, y));
+        valid = valid && core -> inBoard(core -> barriers -> back());
+    }
+
+    int x = get16(in), y = get16(in);
+    Cell chunk(x, y);
+
+    for (std::uint32_t i = 0; i < bodyLength && valid; i++) {
+        if (i > 0) {
+            int dir = (in[(i - 1) / 4] >> (2 * ((i - 1) % 4))) & 3;
+            chunk = chunk.next(static_cast<Direction>(dir));
+        }
+        valid = core -> inBoard(chunk);
+        if (valid)
+            core -> body[i] = static_cast<Index>(core -> cellIndex(chunk));
+    }
+
+    core -> length = static_cast<int>(bodyLength);
+    in += (bodyLength - 1 + 3) / 4;
+
+    if (valid) {
+        core -> resetGrid();
+        valid = core -> isPlayable();
+    }
+
+    // the stored order must name exactly the free cells of the rebuilt grid
+    std::uint32_t freeCount = valid ? get32(in) : 0;
+    valid = valid && freeCount == static_cast<std::uint32_t>(core -> freeCells.size()) &&
+            size >= expected + 4 + cellSize * static_cast<qint64>(freeCount);
+
+    for (std::uint32_t i = 0; i < freeCount && valid; i++) {
+        int cell = cellSize == 2 ? get16(in) : static_cast<int>(get32(in));
+        valid = cell >= 0 && cell < cells && core -> freePos[cell] != noSlot;
+        if (valid) {
+            core -> freeCells[i] = static_cast<Index>(cell);
+            core -> freePos[cell] = noSlot;
+        }
+    }
+
+    if (!valid) {
+        delete core;
+        return nullptr;
+    }
+
+    for (std::uint32_t i = 0; i < freeCount; i++)
+        core -> freePos[core -> freeCells[i]] = static_cast<Index>(i);
+
+    return core;
+}
+
+// A JSON archive lists no free cells, so a few bytes can name any board;
+// past the largest board the GUI makes it is refused before allocating.
+static const long long jsonCellLimit = 4096ll * 4096;
+
+/*
+ * Streaming JSON archive. The writer emits exactly what QJsonDocument
+ * produces in compact mode for the object built by toJSON: keys sorted,
+ * no whitespace, coordinates as "(x, y)". The reader accepts any valid
+ * JSON object with those keys, in any order and with any whitespace.
+ */
+
+static void appendNumber(std::string &out, std::uint64_t magnitude, bool negative) {
+    char buffer[24];
+    char *end = buffer + sizeof(buffer), *p = end;
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative)
+        *--p = '-';
+    out.append(p, end);
+}
+
+static void appendInt(std::string &out, long long value) {
+    std::uint64_t magnitude = static_cast<std::uint64_t>(value);
+    appendNumber(out, value < 0 ? 0 - magnitude : magnitude, value < 0);
+}
+
+static void appendCoordinate(std::string &out, const Cell &chunk) {
+    out += "\"(";
+    appendInt(out, chunk.x);
+    out += ", ";
+    appendInt(out, chunk.y);
+    out += ")\"";
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::writeJSON(std::string &out) const {
+    assert(status == Pause);
+
+    out.reserve(out.size() + 256 + 16 * (length + barriers -> size()));
+
+    out += "{\"barriers\":[";
+    for (size_t i = 0; i < barriers -> size(); i++) {
+        if (i > 0)
+            out += ',';
+        appendCoordinate(out, (*barriers)[i]);
+    }
+
+    out += "],\"body\":[";
+    for (int i = 0; i < length; i++) {
+        if (i > 0)
+            out += ',';
+        appendCoordinate(out, bodyAt(i));
+    }
+
+    out += "],\"bonus\":";
+    appendCoordinate(out, bonus);
+    out += ",\"bonusCnt\":";
+    appendInt(out, bonusCnt);
+    out += ",\"direction\":";
+    appendInt(out, direction);
+    out += ",\"height\":";
+    appendInt(out, getHeight());
+    out += ",\"rngState\":\"";
+    appendNumber(out, rng.getState(), false);
+    out += "\",\"seed\":\"";
+    appendNumber(out, seed, false);
+    out += "\",\"status\":";
+    appendInt(out, status);
+    out += ",\"timeFromStart\":";
+    appendInt(out, timeFromStart);
+    out += ",\"width\":";
+    appendInt(out, getWidth());
+    out += '}';
+}
+
+namespace {
+
+struct JsonReader {
+    const char *p, *end;
+    bool ok;
+
+    JsonReader(const char *begin, const char *_end) : p {begin}, end {_end}, ok {true} { }
+
+    void fail() {
+        ok = false;
+        p = end;
+    }
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool accept(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c))
+            fail();
+    }
+
+    // leaves [begin, stop) pointing at the raw characters between the quotes
+    void string(const char *&begin, const char *&stop) {
+        expect('"');
+        begin = p;
+        while (p < end && *p != '"')
+            p += *p == '\\' ? 2 : 1;
+        if (p >= end) {
+            fail();
+            return;
+        }
+        stop = p++;
+    }
+
+    long long integer() {
+        skipSpace();
+        bool negative = p < end && *p == '-';
+        if (negative)
+            p++;
+        if (p >= end || *p < '0' || *p > '9') {
+            fail();
+            return 0;
+        }
+        // every integer in an archive fits an int, longer ones are refused
+        // before they can overflow
+        long long value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+            if (value > INT_MAX) {
+                fail();
+                return 0;
+            }
+        }
+        // tolerate a fractional part or exponent on an integral value
+        while (p < end && (*p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-' ||
+                           (*p >= '0' && *p <= '9')))
+            p++;
+        return negative ? -value : value;
+    }
+
+    std::uint64_t decimalString() {
+        const char *begin = nullptr, *stop = nullptr;
+        string(begin, stop);
+        std::uint64_t value = 0;
+        if (begin == stop)
+            fail();
+        for (const char *c = begin; ok && c < stop; c++) {
+            std::uint64_t digit = static_cast<std::uint64_t>(*c - '0');
+            if (*c < '0' || *c > '9' || value > (UINT64_MAX - digit) / 10)
+                fail();
+            value = value * 10 + digit;
+        }
+        return value;
+    }
+
+    Cell coordinate() {
+        const char *begin = nullptr, *stop = nullptr;
+        string(begin, stop);
+        if (!ok)
+            return Cell(-1, -1);
+
+        JsonReader inner(begin, stop);
+        inner.expect('(');
+        long long x = inner.integer();
+        inner.expect(',');
+        long long y = inner.integer();
+        inner.expect(')');
+        // cells hold 16 bit coordinates, anything wider cannot be on a board
+        if (!inner.ok || x < -0x8000 || x > 0x7FFF || y < -0x8000 || y > 0x7FFF)
+            fail();
+        return Cell(x, y);
+    }
+
+    void skipValue() {
+        skipSpace();
+        if (p >= end) {
+            fail();
+            return;
+        }
+
+        const char *begin, *stop;
+        switch (*p) {
+            case '"':
+                string(begin, stop);
+                break;
+            case '{':
+            case '[': {
+                char close = *p == '{' ? '}' : ']';
+                p++;
+                if (accept(close))
+                    break;
+                do {
+                    if (close == '}') {
+                        string(begin, stop);
+                        expect(':');
+                    }
+                    skipValue();
+                } while (ok && accept(','));
+                expect(close);
+                break;
+            }
+            case 't':
+            case 'f':
+            case 'n':
+                while (p < end && *p >= 'a' && *p <= 'z')
+                    p++;
+                break;
+            default:
+                integer();
+        }
+    }
+
+    bool key(const char *begin, const char *stop, const char *name) const {
+        size_t size = static_cast<size_t>(stop - begin);
+        return std::strlen(name) == size && std::equal(begin, stop, name);
+    }
+};
+
+}
+
+template <class Board>
+BasicSnakeCore<Board>* BasicSnakeCore<Board>::fromJSON(const char *data, qint64 size) {
+    JsonReader reader(data, data + size);
+
+    // first pass: scalars, and where the two arrays are, since the board
+    // size is only known once "height" and "width" have been seen
+    const char *bodyStart = nullptr, *barriersStart = nullptr;
+    long long _width = -1, _height = -1, _timeFromStart = 0, _bonusCnt = 0,
+              _status = Origin, _direction = Left;
+    Cell _bonus(-1, -1);
+    bool hasSeed = false, hasState = false;
+    std::uint64_t _seed = 0, rngState = 0;
+
+    reader.expect('{');
+    if (!reader.accept('}')) do {
+        const char *begin = nullptr, *stop = nullptr;
+        reader.string(begin, stop);
+        reader.expect(':');
+        if (!reader.ok)
+            break;
+
+        if (reader.key(begin, stop, "width")) _width = reader.integer();
+        else if (reader.key(begin, stop, "height")) _height = reader.integer();
+        else if (reader.key(begin, stop, "timeFromStart")) _timeFromStart = reader.integer();
+        else if (reader.key(begin, stop, "bonusCnt")) _bonusCnt = reader.integer();
+        else if (reader.key(begin, stop, "status")) _status = reader.integer();
+        else if (reader.key(begin, stop, "direction")) _direction = reader.integer();
+        else if (reader.key(begin, stop, "bonus")) _bonus = reader.coordinate();
+        else if (reader.key(begin, stop, "seed")) {
+            _seed = reader.decimalString();
+            hasSeed = true;
+        } else if (reader.key(begin, stop, "rngState")) {
+            rngState = reader.decimalString();
+            hasState = true;
+        } else {
+            reader.skipSpace();
+            if (reader.key(begin, stop, "body")) bodyStart = reader.p;
+            else if (reader.key(begin, stop, "barriers")) barriersStart = reader.p;
+            reader.skipValue();
+        }
+    } while (reader.ok && reader.accept(','));
+    reader.expect('}');
+
+    if (!reader.ok || _width <= 0 || _height <= 0 || _width > 0xFFFF || _height > 0xFFFF ||
+        _width * _height > jsonCellLimit ||
+        !Board::fits(static_cast<int>(_width), static_cast<int>(_height)) ||
+        _status < Origin || _status > Over || _direction < Left || _direction > Down ||
+        _timeFromStart < 0 || _timeFromStart > INT_MAX || _bonusCnt < 0 || _bonusCnt > INT_MAX)
+        return nullptr;
+
+    if (!hasSeed)
+        _seed = randomSeed();
+
+    BasicSnakeCore *core = new BasicSnakeCore(static_cast<int>(_width), static_cast<int>(_height),
+                                              _seed, static_cast<GameStatus>(_status));
+    core -> direction = static_cast<Direction>(_direction);
+    core -> timeFromStart = static_cast<int>(_timeFromStart);
+    core -> bonusCnt = static_cast<int>(_bonusCnt);
+    core -> bonus = _bonus;
+    core -> rng.setState(hasState ? rngState : _seed);
+
+    // second pass: coordinates go straight into the ring buffer and barriers
+    int capacity = core -> cells();
+    bool valid = true;
+
+    if (bodyStart != nullptr) {
+        JsonReader array(bodyStart, data + size);
+        array.expect('[');
+        if (!array.accept(']')) do {
+            Cell chunk = array.coordinate();
+            valid = valid && core -> length < capacity && core -> inBoard(chunk);
+            if (valid)
+                core -> body[core -> length++] = static_cast<Index>(core -> cellIndex(chunk));
+        } while (valid && array.ok && array.accept(','));
+        valid = valid && array.ok;
+    }
+
+    if (barriersStart != nullptr) {
+        JsonReader array(barriersStart, data + size);
+        array.expect('[');
+        if (!array.accept(']')) do {
+            Cell chunk = array.coordinate();
+            valid = valid && core -> inBoard(chunk);
+            if (valid)
+                core -> barriers -> push_back(chunk);
+        } while (valid && array.ok && array.accept(','));
+        valid = valid && array.ok;
+    }
+
+    if (valid) {
+        core -> resetGrid();
+        valid = core -> isPlayable();
+    }
+
+    if (!valid) {
+        delete core;
+        return nullptr;
+    }
+
+    return core;
+}
+
+template bool BasicSnakeCore<DynamicBoard>::isPlayable() const;
+template QByteArray BasicSnakeCore<DynamicBoard>::toBinary() const;
+template bool BasicSnakeCore<DynamicBoard>::isBinaryArchive(const char*, qint64);
+template BasicSnakeCore<DynamicBoard>* BasicSnakeCore<DynamicBoard>::fromBinary(const char*, qint64);
+template void BasicSnakeCore<DynamicBoard>::writeJSON(std::string&) const;
+template BasicSnakeCore<DynamicBoard>* BasicSnakeCore<DynamicBoard>::fromJSON(const char*, qint64);
+
+template bool BasicSnakeCore<FixedBoard<40, 40>>::isPlayable() const;
+template QByteArray BasicSnakeCore<FixedBoard<40, 40>>::toBinary() const;
+template bool BasicSnakeCore<FixedBoard<40, 40>>::isBinaryArchive(const char*, qint64);
+template BasicSnakeCore<FixedBoard<40, 40>>* BasicSnakeCore<FixedBoard<40, 40>>::fromBinary(const char*, qint64);
+template void BasicSnakeCore<FixedBoard<40, 40>>::writeJSON(std::string&) const;
+template BasicSnakeCore<FixedBoard<40, 40>>* BasicSnakeCore<FixedBoard<40, 40>>::fromJSON(const char*, qint64);
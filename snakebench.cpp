@@ -0,0 +1,469 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegion>
+#include <QResizeEvent>
+
+#include "batchenv.h"
+#include "bitboard.h"
+#include "replay.h"
+#include "snakeboard.h"
+#include "snakecore.h"
+#include "snakerunner.h"
+
+// Every operator new in the process is counted, the benchmarks report the
+// count per operation. Qt containers allocate with malloc and do not show up.
+static std::atomic<long long> allocations {0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+struct Result {
+    long long ops;
+    double nsPerOp, opsPerSec, allocsPerOp;
+};
+
+// One paused game to run the cases on: a serpentine snake of the given
+// length from the top left corner, barriers on a share of the other cells.
+struct Fixture {
+    int width, height, length;
+    double density;
+    std::string archive; // JSON
+};
+
+static qint64 minNsecs = 200 * 1000 * 1000;
+static std::string filter;
+static bool csv = false;
+static volatile long long sink;
+
+static QString cellString(int x, int y) {
+    return QString::fromStdString(Cell(x, y).toString());
+}
+
+static Fixture makeFixture(int width, int height, int length, double density) {
+    Fixture fixture = {width, height, length, density, std::string()};
+    std::vector<bool> taken(static_cast<size_t>(width) * height, false);
+    Random random(0x5eed + width * 31 + length * 7 + static_cast<int>(density * 100));
+
+    // head first, as in a saved game
+    QJsonArray body;
+    for (int i = length - 1; i >= 0; i--) {
+        int y = i / width, x = y % 2 == 0 ? i % width : width - 1 - i % width;
+        body.append(cellString(x, y));
+        taken[y * width + x] = true;
+    }
+
+    QJsonArray barriers;
+    for (int cell = 0; cell < width * height; cell++)
+        if (!taken[cell] && random.bounded(0, 1000) < density * 1000) {
+            barriers.append(cellString(cell % width, cell / width));
+            taken[cell] = true;
+        }
+
+    int bonus;
+    do
+        bonus = random.bounded(0, width * height);
+    while (taken[bonus]);
+
+    // heading on along the serpentine
+    int headRow = (length - 1) / width;
+    bool rowEnd = length % width == 0;
+    Direction direction = rowEnd ? Down : headRow % 2 == 0 ? Right : Left;
+
+    QJsonObject archive;
+    archive.insert("width", width);
+    archive.insert("height", height);
+    archive.insert("body", body);
+    archive.insert("barriers", barriers);
+    archive.insert("bonus", cellString(bonus % width, bonus / width));
+    archive.insert("bonusCnt", 0);
+    archive.insert("direction", static_cast<int>(direction));
+    archive.insert("status", static_cast<int>(SnakeCore::Pause));
+    archive.insert("timeFromStart", 0);
+    archive.insert("seed", QString::number(0x5eedull));
+    fixture.archive = QJsonDocument(archive).toJson(QJsonDocument::Compact).toStdString();
+    return fixture;
+}
+
+// the fixture's game, read the way a saved game is
+static SnakeCore* load(const Fixture &fixture) {
+    SnakeCore *core = SnakeCore::fromJSON(fixture.archive.data(), static_cast<qint64>(fixture.archive.size()));
+    if (core == nullptr) {
+        std::cerr << "snakebench: fixture " << fixture.width << "x" << fixture.height
+                  << " does not load" << std::endl;
+        std::exit(1);
+    }
+    return core;
+}
+
+// runs body(n) with growing n until one run takes at least minNsecs
+template <class Body>
+static Result measure(Body body) {
+    long long n = 1;
+    for (;;) {
+        long long allocs = allocations.load(std::memory_order_relaxed);
+        QElapsedTimer timer;
+        timer.start();
+        body(n);
+        qint64 ns = std::max<qint64>(timer.nsecsElapsed(), 1);
+        allocs = allocations.load(std::memory_order_relaxed) - allocs;
+
+        if (ns >= minNsecs)
+            return Result {n, static_cast<double>(ns) / n, n * 1e9 / ns, static_cast<double>(allocs) / n};
+        n = std::min(n * 100, std::max(n * 2, static_cast<long long>(n * 1.2 * minNsecs / ns)));
+    }
+}
+
+static void report(const char *name, const Fixture &fixture, const Result &result) {
+    if (csv)
+        std::cout << name << "," << fixture.width << "," << fixture.height << "," << fixture.length << ","
+                  << fixture.density << "," << result.ops << "," << result.nsPerOp << ","
+                  << result.opsPerSec << "," << result.allocsPerOp << std::endl;
+    else
+        std::cout << "{\"case\":\"" << name << "\",\"width\":" << fixture.width << ",\"height\":" << fixture.height
+                  << ",\"length\":" << fixture.length << ",\"barriers\":" << fixture.density
+                  << ",\"ops\":" << result.ops << ",\"ns_per_op\":" << result.nsPerOp
+                  << ",\"ops_per_s\":" << result.opsPerSec << ",\"allocs_per_op\":" << result.allocsPerOp
+                  << "}" << std::endl;
+}
+
+template <class Body>
+static void run(const char *name, const Fixture &fixture, Body body) {
+    if (std::string(name).find(filter) == std::string::npos)
+        return;
+    report(name, fixture, measure(body));
+}
+
+// any turn that does not kill the snake right away, the current direction
+// first; the same lookups a player or the simulator makes each step
+static Direction steer(const SnakeCore &core) {
+    Direction current = core.getDirection();
+    Cell head = core.getHead();
+    for (int i = -1; i < 4; i++) {
+        Direction dir = i < 0 ? current : static_cast<Direction>(i);
+        Cell next = head.next(dir);
+        if ((static_cast<int>(dir) ^ 1) != static_cast<int>(current) &&
+                core.inBoard(next) && !core.inBody(next) && !core.inBarrier(next))
+            return dir;
+    }
+    return current;
+}
+
+static void benchCore(const Fixture &fixture) {
+    SnakeCore *core = load(fixture);
+    QByteArray binary = core -> toBinary();
+
+    // steering plus move; a dead snake starts over from the fixture, which
+    // on small crowded boards happens often enough to show in the numbers
+    core -> continuee();
+    run("step", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++) {
+            core -> changeDirection(steer(*core));
+            if (!core -> move()) {
+                delete core;
+                core = SnakeCore::fromBinary(binary.constData(), binary.size());
+                core -> continuee();
+            }
+            core -> clearDirtyCells();
+        }
+    });
+
+    // the archives are written from a paused game
+    delete core;
+    core = load(fixture);
+
+    // what a look-ahead search does per node: copy the game into a core it
+    // keeps, then try a move and take it back
+    SnakeCore copy(*core);
+    run("clone", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            copy = *core;
+        sink = copy.getLength();
+    });
+
+    copy.continuee();
+    run("applyUnapply", fixture, [&](long long n) {
+        SnakeCore::MoveRecord record;
+        long long moved = 0;
+        for (long long i = 0; i < n; i++) {
+            moved += copy.apply(static_cast<Direction>(i & 3), record);
+            copy.unapply(record);
+        }
+        sink = moved;
+    });
+
+    run("genBonus", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            core -> genBonus();
+        core -> clearDirtyCells();
+    });
+
+    std::vector<Cell> probes;
+    Random random(1);
+    for (int i = 0; i < 4096; i++) {
+        int x = random.bounded(0, fixture.width);
+        int y = random.bounded(0, fixture.height);
+        probes.push_back(Cell(x, y));
+    }
+
+    run("inBody", fixture, [&](long long n) {
+        long long hits = 0;
+        for (long long i = 0; i < n; i++)
+            hits += core -> inBody(probes[i & 4095]);
+        sink = hits;
+    });
+
+    // the autopilot's last resort: planes loaded, then the area behind each
+    // side of the head, four fills together
+    BoardBits bits;
+    run("reachable", fixture, [&](long long n) {
+        Cell head = core -> getHead(), from[4];
+        for (int dir = 0; dir < 4; dir++)
+            from[dir] = head.next(static_cast<Direction>(dir));
+
+        int areas[4];
+        long long total = 0;
+        for (long long i = 0; i < n; i++) {
+            bits.load(*core);
+            bits.reachableAreas(from, 4, areas);
+            total += areas[0] + areas[1] + areas[2] + areas[3];
+        }
+        sink = total;
+    });
+
+    run("toJSON", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            sink = core -> toJSON().size();
+    });
+
+    // parseJSON reads this whatever the filter
+    std::string json;
+    core -> writeJSON(json);
+
+    run("writeJSON", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++) {
+            json.clear();
+            core -> writeJSON(json);
+        }
+        sink = static_cast<long long>(json.size());
+    });
+
+    run("toBinary", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            sink = core -> toBinary().size();
+    });
+
+    run("parseJSON", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            delete SnakeCore::fromJSON(json.data(), static_cast<qint64>(json.size()));
+    });
+
+    run("loadBinary", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            delete SnakeCore::fromBinary(binary.constData(), binary.size());
+    });
+
+    delete core;
+}
+
+// 256 games in lockstep with observations, per game step; the actions keep
+// the direction and turn at random one step in eight
+static void benchEnv(int side) {
+    const int games = 256;
+    Fixture fixture = {side, side, 2, 0.0, std::string()};
+    BatchEnv env(games, side, side, 0x5eed);
+
+    std::vector<std::uint8_t> actions(games);
+    std::vector<std::uint64_t> observations(static_cast<size_t>(games) * env.observationWords());
+    Random random(1);
+
+    run("envStep", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i += games) {
+            for (int g = 0; g < games; g++)
+                actions[g] = static_cast<std::uint8_t>(random.bounded(0, 8) == 0 ?
+                                                           random.bounded(0, 4) : env.getDirection(g));
+            env.step(actions.data(), observations.data(), nullptr, nullptr);
+        }
+    });
+}
+
+// the step along a Hamiltonian cycle of an even sided board: row 0 to the
+// right, the other rows in a serpentine back to column 0, then up it
+static Direction cycleStep(const Cell &head, int side) {
+    if (head.y == 0)
+        return head.x < side - 1 ? Right : Down;
+    if (head.x == 0)
+        return Up;
+    if (head.y % 2 == 1)
+        return head.x > 1 || head.y == side - 1 ? Left : Down;
+    return head.x < side - 1 ? Right : Down;
+}
+
+// A snake that follows the cycle, which it can for far longer than an hour
+// on these boards: steps with and without a recorder, then seeks to random
+// steps of an hour recorded at 60 steps per second, each from wherever the
+// one before left the game.
+static void benchReplay(int side) {
+    const int hour = 60 * 60 * 60;
+    Fixture fixture = makeFixture(side, side, 2, 0.0);
+    std::unique_ptr<SnakeCore> loaded(load(fixture));
+    SnakeCore start(*loaded);
+    start.continuee();
+
+    SnakeCore core(start);
+    run("stepCycle", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++) {
+            core.changeDirection(cycleStep(core.getHead(), side));
+            if (!core.move())
+                core = start;
+            core.clearDirtyCells();
+        }
+    });
+
+    ReplayRecorder recorder;
+    core = start;
+    recorder.keyframe(core);
+    run("stepRecorded", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++) {
+            core.changeDirection(cycleStep(core.getHead(), side));
+            bool alive = core.move();
+            recorder.record(core);
+            if (!alive || recorder.getTicks() >= hour) {
+                core = start;
+                recorder.clear();
+                recorder.keyframe(core);
+            }
+            core.clearDirtyCells();
+        }
+    });
+
+    core = start;
+    recorder.clear();
+    recorder.keyframe(core);
+    for (int tick = 0; tick < hour; tick++) {
+        core.changeDirection(cycleStep(core.getHead(), side));
+        bool alive = core.move();
+        recorder.record(core);
+        if (!alive)
+            break;
+        core.clearDirtyCells();
+    }
+
+    QByteArray replay = recorder.toReplay();
+    std::unique_ptr<ReplayPlayer> player(ReplayPlayer::open(replay.constData(), replay.size()));
+    Random random(1);
+    run("replaySeek", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            player -> seek(random.bounded(0, player -> getTicks() + 1));
+        sink = player -> getCore().getLength();
+    });
+}
+
+// The board widget painted into an image, never shown: a whole frame, and
+// a small patch as left by a step.
+static void benchPaint(const Fixture &fixture, const QSize &size) {
+    SnakeRunner runner;
+    SnakeBoard board;
+    board.setRunner(&runner);
+
+    SnakeCore *old = board.getCore();
+    board.replaceCore(load(fixture));
+    delete old;
+
+    board.resize(size);
+    QResizeEvent resized(size, QSize());
+    QApplication::sendEvent(&board, &resized);
+    board.refresh();
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+
+    run("paint", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            board.render(&image);
+    });
+
+    // a 48 pixel square in the middle, about what one step repaints on a
+    // zoomed in board
+    QRegion patch(QRect(size.width() / 2 - 24, size.height() / 2 - 24, 48, 48));
+    run("paintPatch", fixture, [&](long long n) {
+        for (long long i = 0; i < n; i++)
+            board.render(&image, QPoint(), patch);
+    });
+
+    delete board.getCore();
+}
+
+int main(int argc, char *argv[]) {
+    // painting needs no display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("snakebench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the core and the board painting over a grid of board sizes, "
+                                     "snake lengths and barrier densities.");
+    parser.addHelpOption();
+
+    QCommandLineOption filterOption("filter", "Only run cases whose name contains this.", "name");
+    QCommandLineOption timeOption("min-time", "Least time spent on each case.", "ms", "200");
+    QCommandLineOption csvOption("csv", "Print CSV instead of one JSON object per line.");
+    QCommandLineOption sizeOption("paint-size", "Side of the painted widget.", "pixels", "800");
+    parser.addOption(filterOption);
+    parser.addOption(timeOption);
+    parser.addOption(csvOption);
+    parser.addOption(sizeOption);
+    parser.process(app);
+
+    filter = parser.value(filterOption).toStdString();
+    minNsecs = std::max(1, parser.value(timeOption).toInt()) * 1000000ll;
+    csv = parser.isSet(csvOption);
+    int side = std::max(16, parser.value(sizeOption).toInt());
+
+    if (csv)
+        std::cout << "case,width,height,length,barriers,ops,ns_per_op,ops_per_s,allocs_per_op" << std::endl;
+
+    const int sides[] = {20, 40, 128, 512};
+    const double densities[] = {0.0, 0.1};
+
+    for (int boardSide: sides) {
+        benchEnv(boardSide);
+        benchReplay(boardSide);
+
+        // a short snake, and one filling half of the board
+        const int lengths[] = {10, boardSide * boardSide / 2};
+        for (int length: lengths)
+            for (double density: densities) {
+                Fixture fixture = makeFixture(boardSide, boardSide, length, density);
+                benchCore(fixture);
+                benchPaint(fixture, QSize(side, side));
+            }
+    }
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+# Benchmarks for the core and the board painting, see snakebench.cpp. Prints
+# one JSON object per case, or CSV with --csv, to be kept across releases.
+
+TEMPLATE = app
+TARGET = snakebench
+CONFIG += console
+CONFIG -= app_bundle
+QT += core gui widgets
+
+include(common.pri)
+include(snakecore.pri)
+
+SOURCES += \
+    snakebench.cpp \
+    snakeboard.cpp
+
+HEADERS += \
+    snakeboard.h
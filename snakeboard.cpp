@@ -1,5 +1,7 @@
 #include <QMouseEvent>
-#include <QTimer>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QWheelEvent>
 
 #include "snakeboard.h"
 
@@ -10,67 +12,249 @@ const QColor SnakeBoard::backgroundColor = QColor("#28292A");
 const QColor SnakeBoard::bonusColor = QColor("#F4B458");
 const QColor SnakeBoard::selectColor = QColor("#000000");
 
-const int SnakeBoard::timePerRefresh = 50;
+const int SnakeBoard::framebufferThreshold = 128 * 128;
+const int SnakeBoard::staticLayerLimit = 2048 * 2048;
+const int SnakeBoard::minSquareSideLength = 1;
+const int SnakeBoard::maxSquareSideLength = 64;
+const int SnakeBoard::minFittedSideLength = 4;
+const int SnakeBoard::defaultZoom = 12;
 const int boardSideLength = 40;
 
-SnakeBoard::SnakeBoard(QWidget *parent) : QWidget(parent),
-										  painter(nullptr),
-										  timer_refresh {new QTimer()},
-										  core {new SnakeCore(boardSideLength, boardSideLength)} {
-
-	connect(timer_refresh, SIGNAL(timeout()),
-			this, SLOT(repaint()));
+#ifdef SNAKE_INSTRUMENT
+const int SnakeBoard::overlayMsecs = 250;
+#endif
 
-    timer_refresh -> setInterval(timePerRefresh);
-    timer_refresh -> start();
+SnakeBoard::SnakeBoard(QWidget *parent) : QWidget(parent),
+										  core {new SnakeCore(boardSideLength, boardSideLength)},
+										  runner {nullptr},
+										  boardWidth {boardSideLength},
+										  boardHeight {boardSideLength},
+										  squareSideLength {0},
+										  topX {0},
+										  topY {0},
+										  fitted {true},
+										  zoomed {false},
+										  following {true},
+										  zoom {defaultZoom},
+										  camera {0, 0},
+										  panning {false},
+										  hovered {-1, -1},
+										  staticLayerValid {false},
+										  renderMode {CellRender},
+										  framebufferValid {false} {
+#ifdef SNAKE_INSTRUMENT
+    overlay = false;
+#endif
+
+    // hover moves arrive as events, so nothing has to poll the cursor
+    setMouseTracking(true);
 }
 
 SnakeCore* SnakeBoard::getCore() const {
 	return core;
 }
 
-void SnakeBoard::colorGrid(int x, int y, const QColor &color) {
+void SnakeBoard::colorGrid(QPainter &painter, int x, int y, const QColor &color) {
     QRect rect(x * squareSideLength, y * squareSideLength, squareSideLength, squareSideLength);
-    painter -> fillRect(rect, QBrush(color));
+    painter.fillRect(rect, color);
 }
 
-void SnakeBoard::selectGrid(int x, int y, const QColor &color) {
+void SnakeBoard::selectGrid(QPainter &painter, int x, int y, const QColor &color) {
     QRect rect(x * squareSideLength, y * squareSideLength, squareSideLength, squareSideLength);
-    painter -> setPen(color);
-    painter -> drawRect(rect);
+    painter.setPen(color);
+    painter.drawRect(rect);
+}
+
+const BoardSnapshot& SnakeBoard::getView() const {
+    return view;
+}
+
+bool SnakeBoard::inView(const Coordinate &chunk) const {
+    return chunk.x >= 0 && chunk.x < view.width && chunk.y >= 0 && chunk.y < view.height;
+}
+
+unsigned char SnakeBoard::cellAt(const Coordinate &chunk) const {
+    return view.cells[chunk.y * view.width + chunk.x];
+}
+
+void SnakeBoard::renderStaticLayer() {
+    int blockWidth = view.width,
+        blockHeight = view.height;
+
+    staticLayer = QImage((blockWidth + 2) * squareSideLength, (blockHeight + 2) * squareSideLength,
+                         QImage::Format_ARGB32_Premultiplied);
+    staticLayer.fill(barrierColor);
+
+    QPainter painter(&staticLayer);
+    painter.translate(squareSideLength, squareSideLength);
+    painter.fillRect(QRect(0, 0, blockWidth * squareSideLength, blockHeight * squareSideLength),
+                     backgroundColor);
+
+    for (int y = 0; y < blockHeight; y++)
+        for (int x = 0; x < blockWidth; x++)
+            if (cellAt(Coordinate(x, y)) == BoardSnapshot::BarrierCell)
+                colorGrid(painter, x, y, barrierColor);
+
+    staticLayerValid = true;
+}
+
+void SnakeBoard::renderFramebuffer() {
+    int blockWidth = view.width,
+        blockHeight = view.height;
+
+    framebuffer = QImage(blockWidth, blockHeight, QImage::Format_Indexed8);
+    framebuffer.setColorCount(BoardSnapshot::CellValues);
+    framebuffer.setColor(BoardSnapshot::BackgroundCell, backgroundColor.rgb());
+    framebuffer.setColor(BoardSnapshot::BodyCell, bodyColor.rgb());
+    framebuffer.setColor(BoardSnapshot::BodyHeadCell, bodyHeadColor.rgb());
+    framebuffer.setColor(BoardSnapshot::BarrierCell, barrierColor.rgb());
+    framebuffer.setColor(BoardSnapshot::BonusCell, bonusColor.rgb());
+
+    for (int y = 0; y < blockHeight; y++)
+        std::copy_n(view.cells.begin() + y * blockWidth, blockWidth, framebuffer.scanLine(y));
+
+    framebufferValid = true;
+}
+
+void SnakeBoard::renderFramebufferCell(const Coordinate &chunk) {
+    framebuffer.scanLine(chunk.y)[chunk.x] = cellAt(chunk);
+}
+
+// the cached static layer is as big as the board in pixels, so zooming a
+// mid sized board in far enough also moves it to the framebuffer
+void SnakeBoard::chooseRenderMode() {
+    qint64 layerWidth = static_cast<qint64>(view.width + 2) * squareSideLength,
+           layerHeight = static_cast<qint64>(view.height + 2) * squareSideLength;
+    bool large = view.width * view.height > framebufferThreshold ||
+                 layerWidth * layerHeight > staticLayerLimit;
+    RenderMode mode = large ? FramebufferRender : CellRender;
+    if (mode != renderMode)
+        setRenderMode(mode);
+}
+
+SnakeBoard::RenderMode SnakeBoard::getRenderMode() const {
+    return renderMode;
+}
+
+void SnakeBoard::setRenderMode(RenderMode mode) {
+    renderMode = mode;
+    staticLayerValid = false;
+    framebufferValid = false;
+    update();
 }
 
-void SnakeBoard::colorBorder() {
-    int blockWidth = core -> getWidth(),
-        blockHeight = core -> getHeight();
+void SnakeBoard::renderStaticCell(const Coordinate &chunk) {
+    if (!staticLayerValid)
+        return;
+
+    QPainter painter(&staticLayer);
+    painter.translate(squareSideLength, squareSideLength);
+    colorGrid(painter, chunk.x, chunk.y,
+              cellAt(chunk) == BoardSnapshot::BarrierCell ? barrierColor : backgroundColor);
+}
 
-    for (int x = -1, y = -1; x <= blockWidth; x++) colorGrid(x, y, barrierColor);
-    for (int x = blockWidth, y = -1; y <= blockHeight; y++) colorGrid(x, y, barrierColor);
-    for (int x = blockWidth, y = blockHeight; x >= -1; x--) colorGrid(x, y, barrierColor);
-    for (int x = -1, y = blockHeight; y >= -1; y--) colorGrid(x, y, barrierColor);
+QRect SnakeBoard::cellRect(const Coordinate &chunk) const {
+    return QRect(topX + chunk.x * squareSideLength, topY + chunk.y * squareSideLength,
+                 squareSideLength, squareSideLength);
 }
 
-Coordinate SnakeBoard::getCursorCoordinate() const {
-    Coordinate cursor = Coordinate(mapFromGlobal(QCursor::pos()));
-    cursor -= Coordinate(topX, topY);
-    cursor.x = cursor.x / squareSideLength;
-    cursor.y = cursor.y / squareSideLength;
-    return cursor;
+int SnakeBoard::fitSquareSideLength() const {
+    if (view.width == 0 || view.height == 0)
+        return 0;
+    return std::min(width() / (view.width + 4), height() / (view.height + 4));
 }
 
 void SnakeBoard::setTopCoordinate() {
-	int fullSideLength = std::min(width(), height());
-	squareSideLength = fullSideLength / (boardSideLength + 4);
+    int fit = fitSquareSideLength();
+    fitted = !zoomed && fit >= minFittedSideLength;
+
+    int side = fitted ? fit : zoom;
+    if (side != squareSideLength) {
+        squareSideLength = side;
+        staticLayerValid = false;
+        chooseRenderMode();
+    }
+
+    if (fitted)
+        camera = QPointF(view.width / 2.0, view.height / 2.0);
+    else
+        clampCamera();
+
+    topX = width() / 2 - qRound(camera.x() * squareSideLength);
+    topY = height() / 2 - qRound(camera.y() * squareSideLength);
+}
+
+void SnakeBoard::clampCamera() {
+    camera.setX(std::max(0.0, std::min<qreal>(view.width, camera.x())));
+    camera.setY(std::max(0.0, std::min<qreal>(view.height, camera.y())));
+}
+
+// keeps the board point under anchor where it is
+void SnakeBoard::setZoom(int side, const QPoint &anchor) {
+    side = std::max(minSquareSideLength, std::min(maxSquareSideLength, side));
+    if (side == squareSideLength || squareSideLength == 0)
+        return;
+
+    QPointF under = QPointF(anchor.x() - topX, anchor.y() - topY) / squareSideLength;
+    int fit = fitSquareSideLength();
+
+    zoomed = side > fit || fit < minFittedSideLength;
+    zoom = side;
+    camera = under - QPointF(anchor.x() - width() / 2, anchor.y() - height() / 2) / side;
 
-	topX = (width() - sideLength) / 2 + squareSideLength;
-	topY = (height() - sideLength) / 2 + squareSideLength;
+    setTopCoordinate();
+    keepHeadInView();
+    setTopCoordinate();
+    update();
+}
 
-	sideLength = squareSideLength * boardSideLength;
-	qDebug() << width() << " " << height();
+// pushes the camera just far enough to keep the head in the middle half
+// of the widget
+bool SnakeBoard::keepHeadInView() {
+    if (fitted || !following || !inView(view.head))
+        return false;
+
+    qreal slackX = width() / 4.0 / squareSideLength,
+          slackY = height() / 4.0 / squareSideLength,
+          headX = view.head.x + 0.5,
+          headY = view.head.y + 0.5;
+    QPointF old = camera;
+
+    if (headX < camera.x() - slackX)
+        camera.setX(headX + slackX);
+    else if (headX > camera.x() + slackX)
+        camera.setX(headX - slackX);
+
+    if (headY < camera.y() - slackY)
+        camera.setY(headY + slackY);
+    else if (headY > camera.y() + slackY)
+        camera.setY(headY - slackY);
+
+    clampCamera();
+    return camera != old;
+}
+
+void SnakeBoard::followHead() {
+    following = true;
+    if (inView(view.head))
+        camera = QPointF(view.head.x + 0.5, view.head.y + 0.5);
+    setTopCoordinate();
+    update();
 }
 
 void SnakeBoard::mousePressEvent(QMouseEvent *event) {
 
+    if (event -> button() == Qt::RightButton || event -> button() == Qt::MiddleButton) {
+        panning = true;
+        panFrom = event -> pos();
+        panCamera = camera;
+        return;
+    }
+
+    // the core is ours only while the runner is idle; the snapshot may not
+    // show a game just started yet
+    if (runner == nullptr || runner -> isRunning())
+        return;
     if (core -> getStatus() != SnakeCore::Pause &&
         core -> getStatus() != SnakeCore::Origin)
         return;
@@ -78,57 +262,306 @@ void SnakeBoard::mousePressEvent(QMouseEvent *event) {
     if (event -> button() != Qt::LeftButton)
         return;
 
-    qDebug() << "mouse press";
-
-    Coordinate cursor = getCursorCoordinate();
+    Cell cursor = cellUnder(event -> pos()).toCell();
 
-    if (!core -> inBoard(cursor))
+    // a barrier under the snake would make an archive no reader accepts
+    if (!core -> inBoard(cursor) || core -> inBody(cursor))
         return;
 
     if (!core -> inBarrier(cursor))
         core -> addBarrier(cursor);
     else
         core -> eraseBarrier(cursor);
+
+    refresh();
+}
+
+void SnakeBoard::mouseMoveEvent(QMouseEvent *event) {
+    if (panning && !fitted) {
+        QPoint moved = event -> pos() - panFrom;
+        camera = panCamera - QPointF(moved) / squareSideLength;
+        following = false;
+        setTopCoordinate();
+        update();
+    }
+
+    setHovered(cellUnder(event -> pos()));
+}
+
+void SnakeBoard::mouseReleaseEvent(QMouseEvent *event) {
+    if (event -> button() == Qt::RightButton || event -> button() == Qt::MiddleButton)
+        panning = false;
+}
+
+void SnakeBoard::wheelEvent(QWheelEvent *event) {
+    int steps = event -> angleDelta().y() / 120;
+    if (steps == 0)
+        return;
+
+    int side = squareSideLength;
+    for (; steps > 0; steps--)
+        side = std::max(side + 1, side * 5 / 4);
+    for (; steps < 0; steps++)
+        side = std::min(side - 1, side * 4 / 5);
+
+    setZoom(side, mapFromGlobal(QCursor::pos()));
 }
 
-void SnakeBoard::paintEvent(QPaintEvent *) {
+void SnakeBoard::leaveEvent(QEvent *) {
+    setHovered(Coordinate(-1, -1));
+}
 
+// the layout only changes here, so it is not recomputed on every paint
+void SnakeBoard::resizeEvent(QResizeEvent *) {
+    staticLayerValid = false;
     setTopCoordinate();
-    painter = new QPainter(this);
+    update();
+}
 
-    painter -> translate(QPointF(topX, topY));
-    painter -> fillRect(QRect(0, 0, sideLength, sideLength), QBrush(backgroundColor));
+// floor division, so cells left of or above the board map to negative indices
+static int cellOf(int pixel, int side) {
+    return pixel >= 0 ? pixel / side : -((side - 1 - pixel) / side);
+}
 
-    colorBorder();
+Coordinate SnakeBoard::cellUnder(const QPoint &pos) const {
+    if (squareSideLength == 0)
+        return Coordinate(-1, -1);
+    return Coordinate(cellOf(pos.x() - topX, squareSideLength), cellOf(pos.y() - topY, squareSideLength));
+}
 
-    if (core != nullptr) {
-        for (auto &chunk: *core) {
-            colorGrid(chunk.x, chunk.y,
-                      chunk == *(core -> begin()) ?
-                          bodyHeadColor : bodyColor);
-        }
-        Coordinate bonus = core -> getBonus(), cursor = getCursorCoordinate();
-        if (bonus != Coordinate(-1, -1)) {
-            colorGrid(bonus.x, bonus.y, bonusColor);
+void SnakeBoard::setHovered(const Coordinate &cell) {
+    Coordinate cursor = inView(cell) ? cell : Coordinate(-1, -1);
+    if (cursor == hovered)
+        return;
+
+    // the outline is drawn on the cell border, so repaint a pixel around it
+    if (inView(hovered))
+        update(cellRect(hovered).adjusted(-1, -1, 1, 1));
+    if (inView(cursor))
+        update(cellRect(cursor).adjusted(-1, -1, 1, 1));
+    hovered = cursor;
+}
+
+QRect SnakeBoard::exposedCells(const QRect &exposed) const {
+    QRect area = exposed.translated(-topX, -topY);
+    int left = std::max(0, cellOf(area.left(), squareSideLength)),
+        right = std::min(view.width - 1, cellOf(area.right(), squareSideLength)),
+        top = std::max(0, cellOf(area.top(), squareSideLength)),
+        bottom = std::min(view.height - 1, cellOf(area.bottom(), squareSideLength));
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+// both painters below expect the painter translated to the top left cell
+
+void SnakeBoard::paintCells(QPainter &painter, const QRect &exposed) {
+    if (!staticLayerValid)
+        renderStaticLayer();
+
+    // one blit of the cached layer for the exposed area ...
+    QRect area = QRect(QPoint(-squareSideLength, -squareSideLength), staticLayer.size()) &
+                 exposed.translated(-topX, -topY);
+    painter.drawImage(area, staticLayer, area.translated(squareSideLength, squareSideLength));
+
+    // ... then the snake and the bonus, only for the cells touching it
+    QRect cells = exposedCells(exposed);
+
+    for (int y = cells.top(); y <= cells.bottom(); y++)
+        for (int x = cells.left(); x <= cells.right(); x++)
+            switch (cellAt(Coordinate(x, y))) {
+                case BoardSnapshot::BodyCell:
+                    colorGrid(painter, x, y, bodyColor);
+                    break;
+                case BoardSnapshot::BodyHeadCell:
+                    colorGrid(painter, x, y, bodyHeadColor);
+                    break;
+                case BoardSnapshot::BonusCell:
+                    colorGrid(painter, x, y, bonusColor);
+                    break;
+                default:
+                    break;
+            }
+}
+
+void SnakeBoard::paintFramebuffer(QPainter &painter, const QRect &exposed) {
+    if (!framebufferValid)
+        renderFramebuffer();
+
+    int blockWidth = view.width,
+        blockHeight = view.height;
+
+    // the border is four strips, the board one unsmoothed scaled blit of the
+    // pixels under the exposed area
+    QRect border[4] = {
+        QRect(-squareSideLength, -squareSideLength, (blockWidth + 2) * squareSideLength, squareSideLength),
+        QRect(-squareSideLength, blockHeight * squareSideLength, (blockWidth + 2) * squareSideLength, squareSideLength),
+        QRect(-squareSideLength, 0, squareSideLength, blockHeight * squareSideLength),
+        QRect(blockWidth * squareSideLength, 0, squareSideLength, blockHeight * squareSideLength)
+    };
+    for (auto &strip: border)
+        painter.fillRect(strip, barrierColor);
+
+    QRect cells = exposedCells(exposed);
+    if (cells.isEmpty())
+        return;
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(QRect(cells.left() * squareSideLength, cells.top() * squareSideLength,
+                            cells.width() * squareSideLength, cells.height() * squareSideLength),
+                      framebuffer, cells);
+}
+
+void SnakeBoard::paintEvent(QPaintEvent *event) {
+
+    if (squareSideLength == 0 || view.width == 0)
+        return;
+
+    QPainter painter(this);
+
+    // the board only, the overlay drawn after it is not part of the timing
+    {
+        SNAKE_TIME_SCOPE(PaintTime);
+        painter.translate(QPointF(topX, topY));
+
+        if (renderMode == FramebufferRender)
+            paintFramebuffer(painter, event -> rect());
+        else
+            paintCells(painter, event -> rect());
+
+        if (inView(hovered)) {
+            selectGrid(painter, hovered.x, hovered.y, selectColor);
         }
+    }
+
+#ifdef SNAKE_INSTRUMENT
+    if (overlay)
+        paintOverlay(painter);
+#endif
+}
 
-        if (core -> inBoard(cursor)) {
-            selectGrid(cursor.x, cursor.y, selectColor);
+#ifdef SNAKE_INSTRUMENT
+void SnakeBoard::toggleOverlay() {
+    overlay = !overlay;
+    overlayAge.start();
+    update();
+}
+
+bool SnakeBoard::hasOverlay() const {
+    return overlay;
+}
+
+void SnakeBoard::paintOverlay(QPainter &painter) {
+    QStringList lines;
+    for (int m = 0; m < Instrument::MetricCount; m++)
+        lines << QString::fromStdString(Instrument::summary(static_cast<Instrument::Metric>(m)));
+
+    QFontMetrics metrics = painter.fontMetrics();
+    int margin = 6, lineHeight = metrics.height(), textWidth = 0;
+    for (const QString &line: lines)
+        textWidth = std::max(textWidth, metrics.boundingRect(line).width());
+
+    painter.resetTransform();
+    overlayRect = QRect(0, 0, textWidth + 2 * margin, lines.size() * lineHeight + 2 * margin);
+    painter.fillRect(overlayRect, QColor(0, 0, 0, 160));
+    painter.setPen(bodyHeadColor);
+    for (int i = 0; i < lines.size(); i++)
+        painter.drawText(QRect(margin, margin + i * lineHeight, textWidth, lineHeight),
+                         Qt::AlignLeft | Qt::AlignVCenter, lines[i]);
+}
+#endif
+
+void SnakeBoard::apply(const BoardSnapshot &snapshot) {
+    bool resized = snapshot.width != view.width || snapshot.height != view.height;
+
+    view.width = snapshot.width;
+    view.height = snapshot.height;
+    view.status = snapshot.status;
+    view.time = snapshot.time;
+    view.score = snapshot.score;
+    view.head = snapshot.head;
+    view.bonus = snapshot.bonus;
+
+    if (snapshot.full) {
+        view.cells = snapshot.cells;
+        staticLayerValid = false;
+        framebufferValid = false;
+        if (resized) {
+            chooseRenderMode();
+            followHead();
+        } else if (keepHeadInView()) {
+            setTopCoordinate();
         }
+        update();
+        return;
+    }
 
-        for (auto it = core -> barrier_begin(); it != core -> barrier_end(); it++)
-            colorGrid(it -> x, it -> y, barrierColor);
+    for (auto &change: snapshot.changes) {
+        Coordinate chunk(change.cell % view.width, change.cell / view.width);
+        unsigned char &cell = view.cells[change.cell];
+        bool barrier = cell == BoardSnapshot::BarrierCell || change.value == BoardSnapshot::BarrierCell;
+
+        cell = change.value;
+        if (barrier)
+            renderStaticCell(chunk);
+        if (framebufferValid)
+            renderFramebufferCell(chunk);
+        update(cellRect(chunk));
     }
 
-    delete painter;
+    if (keepHeadInView()) {
+        setTopCoordinate();
+        update();
+    }
+}
+
+void SnakeBoard::drain() {
+    if (const BoardSnapshot *snapshot = runner -> acquire())
+        apply(*snapshot);
+}
+
+void SnakeBoard::refresh() {
+    if (runner == nullptr)
+        return;
+
+    // an idle runner leaves the core to us, so its changes are published
+    // from here; the first drain frees the slot the publish needs
+    drain();
+    if (!runner -> isRunning()) {
+        runner -> publish();
+        drain();
+    }
+
+#ifdef SNAKE_INSTRUMENT
+    // a few times a second is enough to read, and keeps the overlay's own
+    // repaints out of the paint timings
+    if (overlay && overlayAge.elapsed() >= overlayMsecs) {
+        overlayAge.restart();
+        update(overlayRect);
+    }
+#endif
 }
 
 SnakeCore* SnakeBoard::newCore() {
     delete core;
-    core = new SnakeCore(boardSideLength, boardSideLength);
+    core = new SnakeCore(boardWidth, boardHeight);
+    runner -> setCore(core);
+    refresh();
     return core;
 }
 
 void SnakeBoard::replaceCore(SnakeCore *_core) {
     core = _core;
+    runner -> setCore(core);
+    refresh();
+}
+
+void SnakeBoard::setRunner(SnakeRunner *_runner) {
+    runner = _runner;
+    runner -> setCore(core);
+    refresh();
+}
+
+SnakeCore* SnakeBoard::setBoardSize(int _width, int _height) {
+    boardWidth = _width;
+    boardHeight = _height;
+    return newCore();
 }
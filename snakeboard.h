@@ -4,33 +4,111 @@
 #include <QWidget>
 #include <QPainter>
 #include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
 #include <QString>
 
+#include "boardsnapshot.h"
+#include "instrument.h"
 #include "snakecore.h"
+#include "snakerunner.h"
 #include "utils.h"
 
 class SnakeBoard : public QWidget {
     Q_OBJECT
 public:
+    // CellRender fills one rectangle per occupied cell over a cached static
+    // layer; FramebufferRender keeps one 8-bit pixel per cell and draws the
+    // board with a single scaled drawImage, for boards too big for the former
+    enum RenderMode {CellRender, FramebufferRender};
+
     explicit SnakeBoard(QWidget *parent = nullptr);
 	bool move();
 
 	SnakeCore* getCore() const;
     SnakeCore* newCore();
+    SnakeCore* setBoardSize(int _width, int _height);
     void replaceCore(SnakeCore *_core);
+    void setRunner(SnakeRunner *_runner);
+
+    // applies the snapshots published since the last call and schedules a
+    // repaint of the cells they changed
+    void refresh();
+
+    // the board as last shown, safe to read while the runner plays
+    const BoardSnapshot& getView() const;
+
+    RenderMode getRenderMode() const;
+    void setRenderMode(RenderMode mode);
+
+    // the camera keeps the head in view until the user pans away
+    void followHead();
+
+#ifdef SNAKE_INSTRUMENT
+    // p50/p99/max of the instrumented hot paths in the top left corner
+    void toggleOverlay();
+    bool hasOverlay() const;
+#endif
 
 private:
 
 	static int timePerStep; 
-	const static int timePerRefresh;
+	const static int framebufferThreshold;
+	const static int staticLayerLimit;
+	const static int minSquareSideLength, maxSquareSideLength;
+	const static int minFittedSideLength, defaultZoom;
 
     void setTopCoordinate();
+    int fitSquareSideLength() const;
+    void setZoom(int side, const QPoint &anchor);
+    void clampCamera();
+    bool keepHeadInView();
 
-    QPainter *painter;
-    QTimer *timer_move, *timer_refresh;
+    QTimer *timer_move;
     SnakeCore *core;
+    SnakeRunner *runner;
+    int boardWidth, boardHeight; // size of the cores newCore makes
+
+    // header of the latest snapshot, cells holds one value per cell; this
+    // is all the painting code looks at
+    BoardSnapshot view;
 	int squareSideLength;
-	int topX, topY, sideLength;
+	int topX, topY;
+
+    // the whole board is fitted into the widget until it gets too small to
+    // see or the user zooms; after that squareSideLength is zoom and the
+    // cell at camera, in cells, is drawn at the middle of the widget
+    bool fitted, zoomed, following;
+    int zoom;
+    QPointF camera;
+
+    // right or middle button drag pans the camera
+    bool panning;
+    QPoint panFrom;
+    QPointF panCamera;
+
+    // cell under the mouse, kept up to date by mouse tracking
+    Coordinate hovered;
+
+    // background, border and barriers, which only change on resize and
+    // barrier edits; its top left corner is the top left border cell
+    QImage staticLayer;
+    bool staticLayerValid;
+
+    RenderMode renderMode;
+
+    // FramebufferRender only: width x height copy of view.cells as pixels
+    // indexing the palette
+    QImage framebuffer;
+    bool framebufferValid;
+
+#ifdef SNAKE_INSTRUMENT
+    const static int overlayMsecs;
+    bool overlay;
+    QRect overlayRect;
+    QElapsedTimer overlayAge;
+    void paintOverlay(QPainter &painter);
+#endif
 
     const static QColor backgroundColor;
     const static QColor bodyHeadColor;
@@ -39,16 +117,35 @@ private:
     const static QColor bonusColor;
     const static QColor selectColor;
 
-    void colorGrid(int x, int y, const QColor &color);
-    void selectGrid(int x, int y, const QColor &color);
-    void colorBorder();
-    Coordinate getCursorCoordinate() const;
-
-	void paintEvent(QPaintEvent *);
+    void colorGrid(QPainter &painter, int x, int y, const QColor &color);
+    void selectGrid(QPainter &painter, int x, int y, const QColor &color);
+    void renderStaticLayer();
+    void renderStaticCell(const Coordinate &chunk);
+    void renderFramebuffer();
+    void renderFramebufferCell(const Coordinate &chunk);
+    unsigned char cellAt(const Coordinate &chunk) const;
+    bool inView(const Coordinate &chunk) const;
+    void chooseRenderMode();
+    void apply(const BoardSnapshot &snapshot);
+    void drain();
+
+    QRect exposedCells(const QRect &exposed) const;
+    void paintCells(QPainter &painter, const QRect &exposed);
+    void paintFramebuffer(QPainter &painter, const QRect &exposed);
+    QRect cellRect(const Coordinate &chunk) const;
+    Coordinate cellUnder(const QPoint &pos) const;
+    void setHovered(const Coordinate &cell);
+
+	void paintEvent(QPaintEvent *event);
 
 protected:
 
     void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    void leaveEvent(QEvent *event);
+    void resizeEvent(QResizeEvent *event);
 
 signals:
 
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "autopilot.h"
+#include "replay.h"
+#include "snakecore.h"
+
+// Round trips through every format the game writes, and inputs cut short or
+// damaged that the readers must refuse. Prints each failure and exits
+// non-zero if there was any; run by make check.
+
+static int failures = 0;
+
+static void expect(bool ok, const std::string &what) {
+    if (ok)
+        return;
+    failures++;
+    std::cout << "FAIL " << what << std::endl;
+}
+
+// everything an archive keeps, compared as the JSON text of a paused copy
+template <class Core>
+static std::string state(const Core &core) {
+    Core copy(core);
+    copy.pause();
+    std::string json = std::to_string(core.getStatus()) + " ";
+    copy.writeJSON(json);
+    return json;
+}
+
+// A game of the given length played by the autopilot on a board with a
+// few barriers, paused.
+template <class Core>
+static Core playedGame(int width, int height, std::uint64_t seed, int steps) {
+    Core core(width, height, seed);
+    for (int x = 1; x < width - 1; x += 5)
+        if (!core.inBody(Cell(x, 1)) && core.getBonus() != Cell(x, 1))
+            core.addBarrier(Cell(x, 1));
+
+    BasicAutopilot<Core> pilot;
+    core.start();
+    for (int i = 0; i < steps && core.getStatus() == Core::Running; i++) {
+        core.changeDirection(pilot.next(core));
+        core.move();
+    }
+    core.pause();
+    core.clearDirtyCells();
+    return core;
+}
+
+// both games take the same steps from here on, bonuses included
+template <class Core>
+static bool playsOnAlike(Core a, Core b, int steps) {
+    BasicAutopilot<Core> pilot;
+    a.continuee();
+    b.continuee();
+    for (int i = 0; i < steps && a.getStatus() == Core::Running; i++) {
+        Direction dir = pilot.next(a);
+        a.changeDirection(dir);
+        b.changeDirection(dir);
+        a.move();
+        b.move();
+        if (state(a) != state(b))
+            return false;
+    }
+    return true;
+}
+
+template <class Core>
+static void checkBinary(const Core &core, const std::string &name) {
+    QByteArray binary = core.toBinary();
+    std::unique_ptr<Core> loaded(Core::fromBinary(binary.constData(), binary.size()));
+    expect(loaded != nullptr, name + ": binary archive loads");
+    if (loaded == nullptr)
+        return;
+    expect(state(*loaded) == state(core), name + ": binary archive keeps the game");
+    expect(loaded -> toBinary() == binary, name + ": binary archive writes back the same bytes");
+    expect(playsOnAlike(core, *loaded, 500), name + ": binary archive plays on alike");
+
+    // a few thousand places at most on the larger boards
+    int stride = std::max(1, binary.size() / 2000);
+    for (int size = 0; size < binary.size(); size += stride)
+        expect(Core::fromBinary(binary.constData(), size) == nullptr,
+               name + ": binary archive cut to " + std::to_string(size) + " bytes is refused");
+
+    // magic, version, width, body length
+    const int fields[] = {0, 4, 6, 44};
+    for (int offset: fields) {
+        QByteArray damaged = binary;
+        damaged.data()[offset] = static_cast<char>(damaged.at(offset) ^ 0x7F);
+        if (offset == 44)
+            std::fill(damaged.data() + 44, damaged.data() + 48, '\0');
+        expect(Core::fromBinary(damaged.constData(), damaged.size()) == nullptr,
+               name + ": binary archive damaged at byte " + std::to_string(offset) + " is refused");
+    }
+
+    // any single byte changed loads a playable game or nothing
+    for (int offset = 0; offset < binary.size(); offset += stride) {
+        QByteArray damaged = binary;
+        damaged.data()[offset] = static_cast<char>(damaged.at(offset) ^ 0x55);
+        std::unique_ptr<Core> game(Core::fromBinary(damaged.constData(), damaged.size()));
+        if (game != nullptr)
+            expect(playsOnAlike(*game, *game, 50), name + ": damaged binary archive plays");
+    }
+}
+
+template <class Core>
+static void checkJSON(const Core &core, const std::string &name) {
+    std::string json;
+    core.writeJSON(json);
+    std::unique_ptr<Core> loaded(Core::fromJSON(json.data(), static_cast<qint64>(json.size())));
+    expect(loaded != nullptr, name + ": JSON archive loads");
+    if (loaded == nullptr)
+        return;
+    expect(state(*loaded) == state(core), name + ": JSON archive keeps the game");
+
+    for (size_t size = 0; size < json.size(); size++)
+        expect(Core::fromJSON(json.data(), static_cast<qint64>(size)) == nullptr,
+               name + ": JSON archive cut to " + std::to_string(size) + " bytes is refused");
+}
+
+template <class Core>
+static void checkDamagedJSON(const std::string &name) {
+    // each is this one with one thing wrong
+    const char *whole = "{\"width\":40,\"height\":40,\"body\":[\"(0, 0)\"]}";
+    std::unique_ptr<Core> loaded(Core::fromJSON(whole, static_cast<qint64>(std::string(whole).size())));
+    expect(loaded != nullptr, name + ": JSON archive " + whole + " loads");
+
+    const char *damaged[] = {
+        "{\"width\":18446744073709551656,\"height\":40,\"body\":[\"(0, 0)\"]}",
+        "{\"width\":0,\"height\":40,\"body\":[\"(0, 0)\"]}",
+        "{\"width\":40,\"height\":40,\"body\":[\"(40, 0)\"]}",
+        "{\"width\":40,\"height\":40,\"body\":[\"(0, 0)\",\"(2, 0)\"]}",
+        "{\"width\":40,\"height\":40,\"body\":[\"(0, 0)\"],\"barriers\":[\"(0, 0)\"]}",
+        "{\"width\":40,\"height\":40,\"body\":[\"(0, 0)\"],\"timeFromStart\":2147483648}",
+        "{\"width\":40,\"height\":40,\"body\":[]}"
+    };
+    for (const char *text: damaged)
+        expect(Core::fromJSON(text, static_cast<qint64>(std::string(text).size())) == nullptr,
+               name + ": JSON archive " + text + " is refused");
+}
+
+// A recorded game with a barrier placed halfway, as the runner records it;
+// every step must come back from the replay as it was played, stepping on
+// and seeking back and forth.
+template <class Core>
+static void checkReplay(int width, int height, std::uint64_t seed, const std::string &name) {
+    const int steps = 3000, edit = 1500;
+    Core core(width, height, seed);
+    BasicAutopilot<Core> pilot;
+    BasicReplayRecorder<Core> recorder;
+    std::vector<std::string> states;
+
+    core.start();
+    recorder.keyframe(core);
+    states.push_back(state(core));
+    while (recorder.getTicks() < steps && core.getStatus() == Core::Running) {
+        if (recorder.getTicks() == edit) {
+            core.pause();
+            for (int cell = 0; cell < width * height; cell++) {
+                Cell chunk(cell % width, cell / width);
+                if (!core.inBody(chunk) && !core.inBarrier(chunk) && core.getBonus() != chunk &&
+                        chunk != core.getHead().next(core.getDirection())) {
+                    core.addBarrier(chunk);
+                    break;
+                }
+            }
+            core.continuee();
+            recorder.keyframe(core);
+            states.back() = state(core);
+        }
+        core.changeDirection(pilot.next(core));
+        core.move();
+        recorder.record(core);
+        states.push_back(state(core));
+        core.clearDirtyCells();
+    }
+
+    expect(recorder.getTicks() > edit, name + ": recorded game lasts past the barrier placed");
+
+    QByteArray replay = recorder.toReplay();
+    std::unique_ptr<BasicReplayPlayer<Core>> player(BasicReplayPlayer<Core>::open(replay.constData(), replay.size()));
+    expect(player != nullptr, name + ": replay opens");
+    if (player == nullptr)
+        return;
+    expect(player -> getTicks() == recorder.getTicks(), name + ": replay keeps every step");
+
+    bool alike = true;
+    for (int tick = 0; tick <= player -> getTicks(); tick++)
+        alike = alike && player -> seek(tick) && state(player -> getCore()) == states[tick];
+    expect(alike, name + ": replay played forward matches the game");
+
+    alike = true;
+    Random random(seed);
+    for (int i = 0; i < 200; i++) {
+        int tick = random.bounded(0, player -> getTicks() + 1);
+        alike = alike && player -> seek(tick) && state(player -> getCore()) == states[tick];
+    }
+    expect(alike, name + ": replay seeking back and forth matches the game");
+
+    int stride = std::max(1, replay.size() / 2000);
+    for (int size = 0; size < replay.size(); size += stride)
+        expect(BasicReplayPlayer<Core>::open(replay.constData(), size) == nullptr,
+               name + ": replay cut to " + std::to_string(size) + " bytes is refused");
+
+    // the first keyframe starts right after the 24 byte header
+    QByteArray damaged = replay;
+    damaged.data()[24] = 'X';
+    expect(BasicReplayPlayer<Core>::open(damaged.constData(), damaged.size()) == nullptr,
+           name + ": replay with a damaged first keyframe is refused");
+}
+
+template <class Core>
+static void checkArchives(int width, int height, const std::string &name) {
+    for (std::uint64_t seed = 1; seed <= 3; seed++) {
+        Core core = playedGame<Core>(width, height, seed, static_cast<int>(seed) * 300);
+        std::string game = name + " seed " + std::to_string(seed);
+        checkBinary(core, game);
+        checkJSON(core, game);
+    }
+    checkDamagedJSON<Core>(name);
+}
+
+int main() {
+    checkArchives<SnakeCore>(16, 16, "16x16");
+    checkArchives<SnakeCore>(23, 17, "23x17");
+    checkArchives<SnakeCore>(300, 300, "300x300");
+    checkArchives<SnakeCore40x40>(40, 40, "fixed 40x40");
+
+    checkReplay<SnakeCore>(16, 16, 7, "replay 16x16");
+    checkReplay<SnakeCore40x40>(40, 40, 7, "replay fixed 40x40");
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
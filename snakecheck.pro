@@ -0,0 +1,14 @@
+# Round trips through the archives and the replay format, and damaged
+# inputs the readers must refuse; make check runs it, see snakecheck.cpp.
+
+TEMPLATE = app
+TARGET = snakecheck
+CONFIG += console testcase
+CONFIG -= app_bundle
+QT = core
+
+include(common.pri)
+include(snakecore.pri)
+
+SOURCES += \
+    snakecheck.cpp
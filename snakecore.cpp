@@ -1,221 +1,456 @@
 #include "snakecore.h"
 
-#include <QRandomGenerator>
-#include <QDebug>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QJsonDocument>
+#include <algorithm>
 
-const int SnakeCore::dx[4] = {0, 1, 0, -1};
-const int SnakeCore::dy[4] = {-1, 0, 1, 0};
+template <class Board>
+constexpr typename BasicSnakeCore<Board>::Index BasicSnakeCore<Board>::noSlot;
+template <class Board>
+constexpr int BasicSnakeCore<Board>::dx[4];
+template <class Board>
+constexpr int BasicSnakeCore<Board>::dy[4];
+template <class Board>
+const int BasicSnakeCore<Board>::dirtyLimit = 4096;
 
-int SnakeCore::lrand(int l, int r) const {
-    return QRandomGenerator::global() -> bounded(l, r);
+template <class Board>
+int BasicSnakeCore<Board>::lrand(int l, int r) const {
+    return rng.bounded(l, r);
 }
 
-int SnakeCore::getRandX() const {
-    return lrand(0, width - 1);
+template <class Board>
+std::uint64_t BasicSnakeCore<Board>::randomSeed() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device();
 }
 
-int SnakeCore::getRandY() const {
-    return lrand(0, height - 1);
+template <class Board>
+int BasicSnakeCore<Board>::getRandX() const {
+    return lrand(0, getWidth() - 1);
 }
 
-Coordinate SnakeCore::getRandXY() const {
-    return Coordinate(getRandX(), getRandY());
+template <class Board>
+int BasicSnakeCore<Board>::getRandY() const {
+    return lrand(0, getHeight() - 1);
 }
 
-Coordinate SnakeCore::getSafeXY() const {
-    int d_width = width / 5, d_height = height / 5;
-    return Coordinate( 	lrand(d_width, width - d_height),
-                        lrand(d_height, height - d_height));
+template <class Board>
+Cell BasicSnakeCore<Board>::getRandXY() const {
+    // x is drawn first, the order of arguments in a call is left open
+    int x = getRandX();
+    int y = getRandY();
+    return Cell(x, y);
 }
 
-SnakeCore::GameStatus SnakeCore::getStatus() const {
+template <class Board>
+Cell BasicSnakeCore<Board>::getSafeXY() const {
+    int d_width = getWidth() / 5, d_height = getHeight() / 5;
+    int x = lrand(d_width, getWidth() - d_width);
+    int y = lrand(d_height, getHeight() - d_height);
+    return Cell(x, y);
+}
+
+template <class Board>
+SnakeCoreBase::GameStatus BasicSnakeCore<Board>::getStatus() const {
     return status;
 }
 
-SnakeCore::iterator SnakeCore::begin() {
-    return body.begin();
+template <class Board>
+typename BasicSnakeCore<Board>::iterator BasicSnakeCore<Board>::begin() const {
+    return iterator(this, head, length);
+}
+
+template <class Board>
+typename BasicSnakeCore<Board>::iterator BasicSnakeCore<Board>::end() const {
+    return iterator(this, head, 0);
+}
+
+template <class Board>
+typename BasicSnakeCore<Board>::barrier_iterator BasicSnakeCore<Board>::barrier_begin() const {
+    return barriers -> cbegin();
+}
+
+template <class Board>
+typename BasicSnakeCore<Board>::barrier_iterator BasicSnakeCore<Board>::barrier_end() const {
+    return barriers -> cend();
+}
+
+template <class Board>
+const std::vector<Cell>& BasicSnakeCore<Board>::getBarriers() const {
+    return *barriers;
+}
+
+// the barriers of this core alone, copied first if a copy still shares them
+template <class Board>
+std::vector<Cell>& BasicSnakeCore<Board>::editBarriers() {
+    if (barriers.use_count() > 1)
+        barriers = std::make_shared<std::vector<Cell>>(*barriers);
+    return *barriers;
+}
+
+template <class Board>
+Cell BasicSnakeCore<Board>::bodyAt(int i) const {
+    return cellAt(body[(head + i) % this -> cells()]);
+}
+
+template <class Board>
+int BasicSnakeCore<Board>::cellIndex(const Cell &chunk) const {
+    return this -> index(chunk.x, chunk.y);
+}
+
+template <class Board>
+Cell BasicSnakeCore<Board>::cellAt(int cell) const {
+    return Cell(cell % getWidth(), cell / getWidth());
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::resetBody() {
+    head = 0;
+    length = 0;
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::resetGrid() {
+    int cells = this -> cells();
+
+    std::fill(grid.begin(), grid.end(), static_cast<unsigned char>(EmptyCell));
+    for (int i = 0; i < length; i++)
+        grid[cellIndex(bodyAt(i))] |= BodyCell;
+    for (auto &chunk: *barriers)
+        grid[cellIndex(chunk)] |= BarrierCell;
+
+    freeCells.clear();
+    std::fill(freePos.begin(), freePos.end(), noSlot);
+    for (int cell = 0; cell < cells; cell++) if (grid[cell] == EmptyCell) {
+        freePos[cell] = static_cast<Index>(freeCells.size());
+        freeCells.push_back(static_cast<Index>(cell));
+    }
 }
 
-SnakeCore::iterator SnakeCore::end() {
-    return body.end();
+template <class Board>
+void BasicSnakeCore<Board>::markDirty(const Cell &chunk) {
+    if (dirtyAll)
+        return;
+    if (static_cast<int>(dirtyCells.size()) >= std::max(dirtyLimit, this -> cells() / 8)) {
+        dirtyCells.clear();
+        dirtyAll = true;
+        return;
+    }
+    dirtyCells.push_back(chunk);
 }
 
-SnakeCore::iterator SnakeCore::barrier_begin() {
-    return barriers.begin();
+template <class Board>
+void BasicSnakeCore<Board>::occupy(int cell, unsigned char flag) {
+    if (grid[cell] == EmptyCell) {
+        Index pos = freePos[cell], last = freeCells.back();
+        freeCells[pos] = last;
+        freePos[last] = pos;
+        freeCells.pop_back();
+        freePos[cell] = noSlot;
+    }
+    grid[cell] |= flag;
 }
 
-SnakeCore::iterator SnakeCore::barrier_end() {
-    return barriers.end();
+template <class Board>
+void BasicSnakeCore<Board>::release(int cell, unsigned char flag) {
+    grid[cell] &= ~flag;
+    if (grid[cell] == EmptyCell && freePos[cell] == noSlot) {
+        freePos[cell] = static_cast<Index>(freeCells.size());
+        freeCells.push_back(static_cast<Index>(cell));
+    }
 }
 
-void SnakeCore::init() {
-    body.push_back( getSafeXY() );
-    body.push_back( body.back().next(static_cast<Direction>(lrand(0, 3))) );
-    direction = body.back().calcDirection(body.front());
+template <class Board>
+void BasicSnakeCore<Board>::init() {
+    resetBody();
+    Cell first = getSafeXY(),
+               second = first.next(static_cast<Direction>(lrand(0, 3)));
+    body[0] = static_cast<Index>(cellIndex(first));
+    body[1] = static_cast<Index>(cellIndex(second));
+    length = 2;
+    resetGrid();
+    direction = second.calcDirection(first);
     genBonus();
 }
 
-SnakeCore::SnakeCore(int _width, int _height) :
-    width {_width},
-    height {_height},
+template <class Board>
+BasicSnakeCore<Board>::BasicSnakeCore(int _width, int _height) :
+    BasicSnakeCore(_width, _height, randomSeed()) { };
+
+template <class Board>
+BasicSnakeCore<Board>::BasicSnakeCore(int _width, int _height, std::uint64_t _seed) :
+    Board(_width, _height),
+    barriers {std::make_shared<std::vector<Cell>>()},
     timeFromStart {0},
     bonusCnt {0},
     status {Origin},
-    bonus {-1, -1} {
+    bonus {-1, -1},
+    seed {_seed},
+    rng {_seed},
+    dirtyAll {true} {
     init();
 };
 
-SnakeCore::SnakeCore() :
+template <class Board>
+BasicSnakeCore<Board>::BasicSnakeCore(int _width, int _height, std::uint64_t _seed, GameStatus _status) :
+    Board(_width, _height),
+    barriers {std::make_shared<std::vector<Cell>>()},
     timeFromStart {0},
     bonusCnt {0},
-    status {Origin},
-    bonus {-1, -1} {
-    init();
+    status {_status},
+    direction {Left},
+    bonus {-1, -1},
+    seed {_seed},
+    rng {_seed},
+    dirtyAll {true} {
+    resetBody();
+    resetGrid();
 };
 
-SnakeCore::SnakeCore(const QJsonObject &obj) :
-    width {obj["width"].toInt()},
-    height {obj["height"].toInt()},
-    timeFromStart {obj["timeFromStart"].toInt()},
-    bonusCnt {obj["bonusCnt"].toInt()},
-    status {static_cast<GameStatus>(obj["status"].toInt())},
-    direction {static_cast<Direction>(obj["direction"].toInt())},
-    bonus {Coordinate(obj["bonus"].toString())} {
-
-    QJsonArray json_body = obj["body"].toArray();
-    for (auto chunk: json_body)
-        body.push_back(Coordinate(chunk.toString()));
-
-    QJsonArray json_barriers = obj["barriers"].toArray();
-    for (auto chunk: json_barriers)
-        barriers.push_back(Coordinate(chunk.toString()));
-}
-
-int SnakeCore::getWidth() const {
-	return width;
-}
-
-int SnakeCore::getHeight() const {
-	return height;
-}
-
-std::string SnakeCore::getBodyInfo() const {
+template <class Board>
+BasicSnakeCore<Board>::BasicSnakeCore() :
+    BasicSnakeCore(Board::defaultWidth, Board::defaultHeight) { };
+
+template <class Board>
+BasicSnakeCore<Board>::BasicSnakeCore(const BasicSnakeCore &other) :
+    Board(other),
+    barriers {other.barriers},
+    rng {other.rng} {
+    copyState(other);
+}
+
+template <class Board>
+BasicSnakeCore<Board>& BasicSnakeCore<Board>::operator=(const BasicSnakeCore &other) {
+    if (this == &other)
+        return *this;
+
+    // of the body ring only the slots from head to tail, in at most two runs
+    this -> copyBoard(other);
+    int capacity = this -> cells(),
+        first = std::min(other.length, capacity - other.head);
+    std::copy(&other.body[other.head], &other.body[other.head] + first, &body[other.head]);
+    std::copy(&other.body[0], &other.body[0] + (other.length - first), &body[0]);
+
+    copyState(other);
+    return *this;
+}
+
+// Everything but the board storage, the direction queue and the dirty
+// cells. The barriers are shared; setting a pointer that is already equal
+// leaves the shared count, and the cache line under it, alone.
+template <class Board>
+void BasicSnakeCore<Board>::copyState(const BasicSnakeCore &other) {
+    head = other.head;
+    length = other.length;
+
+    if (barriers != other.barriers)
+        barriers = other.barriers;
+
+    timeFromStart = other.timeFromStart;
+    bonusCnt = other.bonusCnt;
+    status = other.status;
+    direction = other.direction;
+    bonus = other.bonus;
+    seed = other.seed;
+    rng = other.rng;
+
+    Direction dropped;
+    while (dir_queue.pop(dropped))
+        ;
+    dirtyCells.clear();
+    dirtyAll = true;
+}
+
+template <class Board>
+std::string BasicSnakeCore<Board>::getBodyInfo() const {
     std::string info;
-    for (auto &chunk: body)
-        info += chunk.toString() + " - ";
+    for (int i = 0; i < length; i++)
+        info += bodyAt(i).toString() + " - ";
     info.pop_back();
     info.pop_back();
     info.pop_back();
     return info;
 }
 
-bool SnakeCore::move() {
+template <class Board>
+bool BasicSnakeCore<Board>::move() {
     assert(status == Running);
 
-    qDebug() << "snakecore moving";
-
     updateDirection();
+    MoveRecord record;
+    return advance(record);
+}
 
-    int length = static_cast<int>(body.size());
+template <class Board>
+bool BasicSnakeCore<Board>::apply(Direction dir, MoveRecord &record) {
+    assert(status == Running);
 
-    if (!inBoard(body.front().next(direction))) {
+    record.direction = direction;
+    if ((static_cast<int>(direction) ^ 1) != static_cast<int>(dir))
+        direction = dir;
+    return advance(record);
+}
+
+// One step in the current direction. Works on cell indices only; with a
+// FixedBoard the bounds check and the index arithmetic are constants folded
+// into the code.
+template <class Board>
+bool BasicSnakeCore<Board>::advance(MoveRecord &record) {
+    record.rngState = rng.getState();
+    record.bonus = bonus;
+    record.timeFromStart = timeFromStart;
+    record.bonusCnt = bonusCnt;
+    record.status = status;
+    record.moved = false;
+
+    int capacity = this -> cells(),
+        headCell = body[head],
+        x = headCell % getWidth() + dx[direction],
+        y = headCell / getWidth() + dy[direction];
+
+    // off the board, into a barrier or into the body
+    if (!this -> contains(x, y) || grid[this -> index(x, y)] != EmptyCell) {
         status = Over;
         return false;
     }
 
-    if (inBarrier(body.front().next(direction))) {
-        status = Over;
-        return false;
-    }
-
-    if (inBody(body.front().next(direction))) {
-        status = Over;
-        return false;
-    }
+    int next = this -> index(x, y);
 
     timeFromStart++;
 
-    if (body.front().next(direction) == bonus) {
+    bool eaten = x == bonus.x && y == bonus.y;
+    if (eaten)
         bonusCnt += 3;
-        genBonus();
-    }
 
-    Coordinate tmp = body.back();
-    for (int i = length - 1; i > 0; i--)
-        body[i] = body[i - 1];
-    body.front() = body.front().next(direction);
+    int tail = head + length - 1;
+    if (tail >= capacity)
+        tail -= capacity;
 
-    if (bonusCnt > 0) {
-        body.push_back(tmp);
+    record.moved = true;
+    record.grew = bonusCnt > 0;
+    if (record.grew) {
+        length++;
         bonusCnt--;
+    } else {
+        release(body[tail], BodyCell);
+        markDirty(cellAt(body[tail]));
     }
 
+    markDirty(cellAt(headCell));
+    head = head == 0 ? capacity - 1 : head - 1;
+    body[head] = static_cast<Index>(next);
+    record.freeSlot = freePos[next];
+    occupy(next, BodyCell);
+    markDirty(Cell(x, y));
+
+    // placed after the body moved so the bonus never lands under the new head
+    if (eaten)
+        genBonus();
+
     return true;
 }
 
-bool SnakeCore::inBoard(const Coordinate &chunk) {
-    return Coordinate(0, 0) <= chunk && chunk <= Coordinate(width - 1, height - 1);
-}
+// advance backwards: the new head leaves the free cells the way occupy
+// took it out, then the tail comes back the way release let it go. The
+// ring slot the head was written to lies outside the body, the tail's
+// slot still holds the tail.
+template <class Board>
+void BasicSnakeCore<Board>::unapply(const MoveRecord &record) {
+    if (record.moved) {
+        int capacity = this -> cells(),
+            cell = body[head];
+
+        grid[cell] &= ~BodyCell;
+        Index slot = static_cast<Index>(record.freeSlot),
+              size = static_cast<Index>(freeCells.size());
+        if (slot == size) {
+            freeCells.push_back(static_cast<Index>(cell));
+        } else {
+            Index moved = freeCells[slot];
+            freeCells.push_back(moved);
+            freePos[moved] = size;
+            freeCells[slot] = static_cast<Index>(cell);
+        }
+        freePos[cell] = slot;
+        markDirty(cellAt(cell));
+
+        head = head + 1 == capacity ? 0 : head + 1;
+        markDirty(cellAt(body[head]));
+
+        if (record.grew) {
+            length--;
+        } else {
+            int tail = head + length - 1;
+            if (tail >= capacity)
+                tail -= capacity;
+
+            int tailCell = body[tail];
+            if (grid[tailCell] == EmptyCell) {
+                freeCells.pop_back();
+                freePos[tailCell] = noSlot;
+            }
+            grid[tailCell] |= BodyCell;
+            markDirty(cellAt(tailCell));
+        }
+    }
 
-void SnakeCore::start() {
-    status = Running;
-}
+    if (bonus != record.bonus && inBoard(bonus))
+        markDirty(bonus);
 
-bool SnakeCore::inBody(const Coordinate &chunk) const {
-    return std::find(body.begin(), body.end(), chunk) != body.end();
+    rng.setState(record.rngState);
+    bonus = record.bonus;
+    timeFromStart = record.timeFromStart;
+    bonusCnt = record.bonusCnt;
+    status = record.status;
+    direction = record.direction;
 }
 
-bool SnakeCore::inBarrier(const Coordinate &chunk) const {
-    return std::find(barriers.begin(), barriers.end(), chunk) != barriers.end();
+template <class Board>
+bool BasicSnakeCore<Board>::inBoard(const Cell &chunk) const {
+    return this -> contains(chunk.x, chunk.y);
 }
 
-bool SnakeCore::genBonus() {
-    int genCnt = 30;
-
-    do {
-        bonus = getSafeXY();
-        genCnt--;
-    } while (inBody(bonus) && genCnt > 0);
-
-    return !inBody(bonus);
+template <class Board>
+void BasicSnakeCore<Board>::start() {
+    status = Running;
 }
 
-QString SnakeCore::toJSON() const {
-    assert(status == Pause);
+template <class Board>
+bool BasicSnakeCore<Board>::inBody(const Cell &chunk) const {
+    return inBoard(chunk) && (grid[cellIndex(chunk)] & BodyCell);
+}
 
-    QJsonObject obj;
-    QJsonArray json_body, json_barriers;
-    for (auto &chunk: body)
-        json_body.push_back(chunk.toQString());
+template <class Board>
+bool BasicSnakeCore<Board>::inBarrier(const Cell &chunk) const {
+    return inBoard(chunk) && (grid[cellIndex(chunk)] & BarrierCell);
+}
 
-    for (auto &chunk: barriers)
-        json_barriers.push_back(chunk.toQString());
+template <class Board>
+bool BasicSnakeCore<Board>::genBonus() {
+    if (freeCells.empty()) {
+        bonus = Cell(-1, -1);
+        return false;
+    }
 
-    obj.insert("width", width);
-    obj.insert("height", height);
-    obj.insert("body", json_body);
-    obj.insert("barriers", json_barriers);
-    obj.insert("bonus", bonus.toQString());
-    obj.insert("timeFromStart", timeFromStart);
-    obj.insert("direction", direction);
-    obj.insert("status", status);
-    obj.insert("bonusCnt", bonusCnt);
+    bonus = cellAt(freeCells[lrand(0, static_cast<int>(freeCells.size()))]);
+    markDirty(bonus);
+    return true;
+}
 
-    QJsonDocument doc(obj);
-    return QString(doc.toJson(QJsonDocument::Compact).toStdString().c_str());
+template <class Board>
+QString BasicSnakeCore<Board>::toJSON() const {
+    std::string json;
+    writeJSON(json);
+    return QString::fromStdString(json);
 }
 
-void SnakeCore::changeDirection(Direction _direction) {
+template <class Board>
+void BasicSnakeCore<Board>::changeDirection(Direction _direction) {
     dir_queue.push(_direction);
 }
 
-void SnakeCore::updateDirection() {
-    while (!dir_queue.empty()) {
-        Direction _direction = dir_queue.front();
-        dir_queue.pop();
+template <class Board>
+void BasicSnakeCore<Board>::updateDirection() {
+    Direction _direction;
+    while (dir_queue.pop(_direction)) {
         if ((static_cast<int>(direction) ^ 1) == static_cast<int>(_direction))
             continue;
         direction = _direction;
@@ -223,42 +458,127 @@ void SnakeCore::updateDirection() {
     }
 }
 
-void SnakeCore::pause() {
+template <class Board>
+void BasicSnakeCore<Board>::pause() {
     status = Pause;
 }
 
-int SnakeCore::getTime() const {
+template <class Board>
+int BasicSnakeCore<Board>::getTime() const {
     return timeFromStart;
 }
 
-int SnakeCore::getScore() const {
-    return static_cast<int>(body.size());
+template <class Board>
+int BasicSnakeCore<Board>::getScore() const {
+    return length;
+}
+
+template <class Board>
+int BasicSnakeCore<Board>::getLength() const {
+    return length;
 }
 
-void SnakeCore::continuee() {
+template <class Board>
+int BasicSnakeCore<Board>::getPendingGrowth() const {
+    return bonusCnt;
+}
+
+template <class Board>
+std::uint64_t BasicSnakeCore<Board>::getSeed() const {
+    return seed;
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::continuee() {
     status = Running;
 }
 
-void SnakeCore::over() {
+template <class Board>
+void BasicSnakeCore<Board>::over() {
     status = Over;
 }
 
-void SnakeCore::clear() {
+// the same game as BasicSnakeCore(width, height, seed) on the storage this
+// core already has, so batches of games allocate nothing
+template <class Board>
+void BasicSnakeCore<Board>::restart(std::uint64_t _seed) {
+    Direction dropped;
+    while (dir_queue.pop(dropped))
+        ;
+
+    editBarriers().clear();
+    timeFromStart = 0;
+    bonusCnt = 0;
     status = Origin;
-    body.clear();
-    barriers.clear();
+    bonus = Cell(-1, -1);
+    seed = _seed;
+    rng.setState(_seed);
+    dirtyCells.clear();
+    dirtyAll = true;
+    init();
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::clear() {
+    status = Origin;
+    head = 0;
+    length = 0;
+    editBarriers().clear();
 	timeFromStart = 0;
-    bonus = Coordinate(-1, -1);
+    bonus = Cell(-1, -1);
+    resetGrid();
+    dirtyCells.clear();
+    dirtyAll = true;
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::addBarrier(const Cell &barrier) {
+    editBarriers().push_back(barrier);
+    occupy(cellIndex(barrier), BarrierCell);
+    markDirty(barrier);
+
+    if (barrier == bonus)
+        genBonus();
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::eraseBarrier(const Cell &barrier) {
+    std::vector<Cell> &own = editBarriers();
+    own.erase(std::find(own.begin(), own.end(), barrier));
+    release(cellIndex(barrier), BarrierCell);
+    markDirty(barrier);
 }
 
-void SnakeCore::addBarrier(const Coordinate &barrier) {
-    barriers.push_back(barrier);
+template <class Board>
+Direction BasicSnakeCore<Board>::getDirection() const {
+    return direction;
 }
 
-void SnakeCore::eraseBarrier(const Coordinate &barrier) {
-    barriers.erase(std::find(barriers.begin(), barriers.end(), barrier));
+template <class Board>
+Cell BasicSnakeCore<Board>::getHead() const {
+    return length > 0 ? cellAt(body[head]) : Cell(-1, -1);
 }
 
-Coordinate SnakeCore::getBonus() const {
+template <class Board>
+Cell BasicSnakeCore<Board>::getBonus() const {
     return bonus;
 }
+
+template <class Board>
+const std::vector<Cell>& BasicSnakeCore<Board>::getDirtyCells() const {
+    return dirtyCells;
+}
+
+template <class Board>
+bool BasicSnakeCore<Board>::isAllDirty() const {
+    return dirtyAll;
+}
+
+template <class Board>
+void BasicSnakeCore<Board>::clearDirtyCells() {
+    dirtyCells.clear();
+    dirtyAll = false;
+}
+
+template class BasicSnakeCore<DynamicBoard>;
+template class BasicSnakeCore<FixedBoard<40, 40>>;
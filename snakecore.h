@@ -4,86 +4,235 @@
 #include <vector>
 #include <chrono>
 #include <random>
-#include <queue>
+#include <iterator>
+#include <memory>
 
-#include <QJsonObject>
+#include <QByteArray>
 
+#include "boardstorage.h"
+#include "spscqueue.h"
 #include "utils.h"
 
-class SnakeCore {
+// The parts of a game that do not depend on the board storage.
+class SnakeCoreBase {
 
 public:
     enum GameStatus {Origin, Running, Pause, Over};
 
-private:
-    int width, height;
-    std::vector<Coordinate> body;
-    std::vector<Coordinate> barriers;
+    // what apply changed, for unapply
+    struct MoveRecord {
+        std::uint64_t rngState;
+        Cell bonus;
+        int timeFromStart, bonusCnt;
+        std::uint32_t freeSlot; // of the new head cell in the free cells
+        GameStatus status;
+        Direction direction;
+        bool moved, grew;
+    };
+};
+
+// The game on a board given by the Board policy from boardstorage.h:
+// SnakeCore on any runtime size, or a FixedBoard specialization for the
+// sizes we ship. Every variant has the same interface; the members are
+// instantiated in snakecore.cpp and snakearchive.cpp for the boards listed
+// at the bottom of this file.
+template <class Board>
+class BasicSnakeCore : public SnakeCoreBase, private Board {
+
+    typedef typename Board::Index Index;
+
+    enum CellFlag {EmptyCell = 0, BodyCell = 1, BarrierCell = 2};
+
+    // circular buffer of width*height cell indices, body[head] is the head
+    // and the following length - 1 slots (wrapping around) run towards the
+    // tail
+    using Board::body;
+    int head, length;
+
+    // the barrier layout, shared by a core and its copies until one of them
+    // edits it; see editBarriers
+    std::shared_ptr<std::vector<Cell>> barriers;
+
+    // one byte of CellFlag bits per cell, kept in sync with body and barriers
+    using Board::grid;
+
+    // every cell that is neither body nor barrier, in no particular order;
+    // freePos[cell] is the slot of cell in freeCells, or noSlot when occupied
+    using Board::freeCells;
+    using Board::freePos;
+    constexpr static Index noSlot = static_cast<Index>(-1);
+
     int timeFromStart, bonusCnt;
 
     GameStatus status;
     Direction direction;
 
-    Coordinate bonus;
+    Cell bonus;
+
+    // filled by changeDirection, which may run on another thread than move
+    SpscQueue<Direction, 64> dir_queue;
+
+    std::uint64_t seed;
+    mutable Random rng;
 
-    std::queue<Direction> dir_queue;
+    // cells whose content changed since clearDirtyCells, for the renderer;
+    // past dirtyLimit entries, or an eighth of the board when that is more,
+    // only dirtyAll is kept; redrawing everything is cheaper by then
+    const static int dirtyLimit;
+    std::vector<Cell> dirtyCells;
+    bool dirtyAll;
 
-    const static int dx[4];
-    const static int dy[4];
+    // steps in Direction order
+    constexpr static int dx[4] = {-1, 1, 0, 0};
+    constexpr static int dy[4] = {0, 0, -1, 1};
 
     int lrand(int l, int r) const;
 
     void init();
+    void resetBody();
+    void resetGrid();
+    int cellIndex(const Cell &chunk) const;
+    Cell cellAt(int cell) const;
+    void markDirty(const Cell &chunk);
+    void occupy(int cell, unsigned char flag);
+    void release(int cell, unsigned char flag);
     int getRandX() const;
     int getRandY() const;
-    Coordinate getRandXY() const;
-    Coordinate getSafeXY() const;
+    Cell getRandXY() const;
+    Cell getSafeXY() const;
+
+    // what a game can be after any number of moves, checked by the archive
+    // readers once the grid is rebuilt; see snakearchive.cpp
+    bool isPlayable() const;
+
+    std::vector<Cell>& editBarriers();
+    void copyState(const BasicSnakeCore &other);
 
-    bool inBody(const Coordinate &chunk) const;
-    bool genBonus();
     void updateDirection();
+    bool advance(MoveRecord &record);
+
+    // an empty board to be filled by the archive readers
+    BasicSnakeCore(int _width, int _height, std::uint64_t _seed, GameStatus _status);
 
 public:
-    SnakeCore();
-    SnakeCore(int _width, int _height);
-    SnakeCore(const QJsonObject &obj);
+    BasicSnakeCore();
+    BasicSnakeCore(int _width, int _height);
+    BasicSnakeCore(int _width, int _height, std::uint64_t _seed);
 
-    ~SnakeCore() = default;
+    // A copy for look-ahead search: it shares the barrier layout with other
+    // and copies the grid, the free cells and the body. The direction queue
+    // starts empty and every cell is dirty. Assigning to a core of the same
+    // size allocates nothing and copies only the live part of the body; a
+    // 40x40 game takes about 0.2 us that way.
+    BasicSnakeCore(const BasicSnakeCore &other);
+    BasicSnakeCore& operator=(const BasicSnakeCore &other);
 
-    typedef std::vector<Coordinate>::iterator iterator;
+    ~BasicSnakeCore() = default;
 
-	int getWidth() const;
-	int getHeight() const;
+    class iterator {
+        const BasicSnakeCore *core;
+        int pos, left;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Cell value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef Cell reference;
+
+        iterator(const BasicSnakeCore *_core, int _pos, int _left) :
+            core {_core}, pos {_pos}, left {_left} { }
+
+        Cell operator*() const { return core -> cellAt(core -> body[pos]); }
+
+        iterator& operator++() {
+            if (++pos == core -> cells())
+                pos = 0;
+            left--;
+            return *this;
+        }
+
+        bool operator==(const iterator &rhs) const { return left == rhs.left; }
+        bool operator!=(const iterator &rhs) const { return left != rhs.left; }
+    };
+
+    typedef std::vector<Cell>::const_iterator barrier_iterator;
+
+    using Board::getWidth;
+    using Board::getHeight;
+    using Board::fits; // whether a width and height can be played on this Board
 
     std::string getBodyInfo() const;
 
-    bool inBarrier(const Coordinate &chunk) const;
-    bool inBoard(const Coordinate &chunk);
+    bool inBody(const Cell &chunk) const;
+    bool inBarrier(const Cell &chunk) const;
+    bool inBoard(const Cell &chunk) const;
 
     void start();
     bool move();
+
+    // move() towards dir, a reversal ignored as changeDirection does, without
+    // touching the direction queue; unapply puts back exactly what apply
+    // changed, free cell order and random state included, so a search can
+    // play a line out on one core and walk it back. Records are undone in
+    // reverse order of apply.
+    bool apply(Direction dir, MoveRecord &record);
+    void unapply(const MoveRecord &record);
     void pause();
     void continuee(); // -ee for keyword
     void over();
     void clear();
+    void restart(std::uint64_t _seed); // a new Origin game, as if built with this seed
 
     int getTime() const;
     int getScore() const;
+    int getLength() const;
+    int getPendingGrowth() const; // steps left during which the tail stays put
+    std::uint64_t getSeed() const;
+
+    static std::uint64_t randomSeed();
 
     QString toJSON() const;
 
+    // the same JSON archive as toJSON, written and parsed in place without
+    // building a document; fromJSON is nullptr for anything it cannot play
+    void writeJSON(std::string &out) const;
+    static BasicSnakeCore* fromJSON(const char *data, qint64 size);
+
+    // compact binary archive, see snakearchive.cpp for the layout
+    QByteArray toBinary() const;
+    static bool isBinaryArchive(const char *data, qint64 size);
+    static BasicSnakeCore* fromBinary(const char *data, qint64 size);
+
     void changeDirection(Direction _direction);
 
-    iterator begin();
-    iterator end();
+    iterator begin() const;
+    iterator end() const;
 
-    iterator barrier_begin();
-    iterator barrier_end();
+    barrier_iterator barrier_begin() const;
+    barrier_iterator barrier_end() const;
+    const std::vector<Cell>& getBarriers() const;
 
     GameStatus getStatus() const;
-    Coordinate getBonus() const;
-    void addBarrier(const Coordinate &barrier);
-    void eraseBarrier(const Coordinate &barrier);
+    Direction getDirection() const;
+    Cell getHead() const;
+    Cell bodyAt(int i) const; // i segments behind the head, i < getLength()
+    Cell getBonus() const;
+    bool genBonus(); // moves the bonus to a random free cell, false when none is left
+    void addBarrier(const Cell &barrier);
+    void eraseBarrier(const Cell &barrier);
+
+    const std::vector<Cell>& getDirtyCells() const;
+    bool isAllDirty() const;
+    void clearDirtyCells();
 };
 
+typedef BasicSnakeCore<DynamicBoard> SnakeCore;
+
+// the default board, see snakesim
+typedef BasicSnakeCore<FixedBoard<40, 40>> SnakeCore40x40;
+
+extern template class BasicSnakeCore<DynamicBoard>;
+extern template class BasicSnakeCore<FixedBoard<40, 40>>;
+
 #endif // SNAKECORE_H
@@ -0,0 +1,9 @@
+# Included by every program that links against the snakecore static library.
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+LIBS += -L$$OUT_PWD -lsnakecore
+
+win32-msvc*: PRE_TARGETDEPS += $$OUT_PWD/snakecore.lib
+else: PRE_TARGETDEPS += $$OUT_PWD/libsnakecore.a
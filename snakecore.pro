@@ -0,0 +1,44 @@
+# Game logic only: depends on QtCore, never on QtGui or QtWidgets, so it
+# can be linked into headless tools.
+
+TEMPLATE = lib
+TARGET = snakecore
+CONFIG += staticlib
+QT = core
+
+DESTDIR = $$OUT_PWD
+
+include(common.pri)
+
+SOURCES += \
+    autopilot.cpp \
+    batchenv.cpp \
+    batchrunner.cpp \
+    bitboard.cpp \
+    boardsnapshot.cpp \
+    instrument.cpp \
+    mctsplayer.cpp \
+    replay.cpp \
+    snakearchive.cpp \
+    snakecore.cpp \
+    snakerunner.cpp \
+    stepscheduler.cpp \
+    utils.cpp \
+    workpool.cpp
+
+HEADERS += \
+    autopilot.h \
+    batchenv.h \
+    batchrunner.h \
+    bitboard.h \
+    boardsnapshot.h \
+    boardstorage.h \
+    instrument.h \
+    mctsplayer.h \
+    replay.h \
+    snakecore.h \
+    snakerunner.h \
+    spscqueue.h \
+    stepscheduler.h \
+    utils.h \
+    workpool.h
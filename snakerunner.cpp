@@ -0,0 +1,184 @@
+#include "snakerunner.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "instrument.h"
+
+const int SnakeRunner::retryMsecs = 4;
+
+SnakeRunner::SnakeRunner() :
+    core {nullptr},
+    running {false},
+    stopping {false},
+    piloting {false},
+    searching {false},
+    searchBudget {scheduler.getStepNsecs() / 2},
+    wantRecording {false},
+    recording {false} { }
+
+SnakeRunner::~SnakeRunner() {
+    stop();
+}
+
+void SnakeRunner::setCore(SnakeCore *_core) {
+    core = _core;
+    recorder.clear();
+}
+
+void SnakeRunner::setSpeed(int stepsPerSecond) {
+    scheduler.setSpeed(stepsPerSecond);
+
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    searchBudget = scheduler.getStepNsecs() / 2;
+}
+
+// the game may have changed while the runner was idle, barriers edited or
+// an archive loaded, so every start takes a keyframe when recording
+void SnakeRunner::start() {
+    stop();
+
+    recording = wantRecording.load(std::memory_order_relaxed);
+    if (recording)
+        recorder.keyframe(*core);
+    else
+        recorder.clear();
+
+    // a key pressed while paused would count the pause as latency
+    SNAKE_DROP_INPUT();
+
+    stopping = false;
+    running.store(true, std::memory_order_release);
+    scheduler.start();
+    worker = std::thread(&SnakeRunner::run, this);
+}
+
+void SnakeRunner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+
+    scheduler.stop();
+    running.store(false, std::memory_order_release);
+}
+
+bool SnakeRunner::isRunning() const {
+    return running.load(std::memory_order_acquire);
+}
+
+void SnakeRunner::setAutopilot(bool on) {
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    piloting = on;
+}
+
+bool SnakeRunner::hasAutopilot() {
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    return piloting;
+}
+
+void SnakeRunner::setSearch(bool on) {
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    if (on && !searcher)
+        searcher.reset(new MctsPlayer());
+    searching = on;
+}
+
+bool SnakeRunner::hasSearch() {
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    return searching;
+}
+
+// Planning stays within the autopilot's budget, so holding the lock over it
+// delays a key press by well under a millisecond. The search takes up to
+// half a step and runs unlocked; a key pressed meanwhile takes the game
+// back, so its move is dropped then.
+void SnakeRunner::steer() {
+    MctsPlayer *player;
+    {
+        std::lock_guard<std::mutex> lock(pilotMutex);
+        if (!piloting)
+            return;
+        if (!searching) {
+            core -> changeDirection(pilot.next(*core));
+            return;
+        }
+        player = searcher.get();
+        player -> setTimeBudget(searchBudget);
+    }
+
+    Direction dir = player -> next(*core);
+
+    std::lock_guard<std::mutex> lock(pilotMutex);
+    if (piloting)
+        core -> changeDirection(dir);
+}
+
+void SnakeRunner::setRecording(bool on) {
+    wantRecording.store(on, std::memory_order_relaxed);
+}
+
+bool SnakeRunner::isRecording() const {
+    return wantRecording.load(std::memory_order_relaxed);
+}
+
+QByteArray SnakeRunner::toReplay() const {
+    return recorder.toReplay();
+}
+
+// the changes stay in the core's dirty list until the reader is ready, so
+// a slow reader costs one larger snapshot later and never a stalled step
+bool SnakeRunner::publish() {
+    if (core == nullptr || !snapshots.canPublish())
+        return false;
+
+    snapshots.back().capture(*core);
+    snapshots.publish();
+    return true;
+}
+
+const BoardSnapshot* SnakeRunner::acquire() {
+    return snapshots.acquire();
+}
+
+void SnakeRunner::run() {
+    bool alive = true, pending = false;
+    std::unique_lock<std::mutex> lock(wakeMutex);
+
+    while (!stopping) {
+        lock.unlock();
+
+        int steps = scheduler.due();
+        pending |= steps > 0;
+        if (steps > 0)
+            SNAKE_RECORD(TicksBehind, static_cast<quint64>(steps - 1));
+        for (; steps > 0 && alive; steps--) {
+            SNAKE_TIME_SCOPE(TickLatency);
+            steer();
+            alive = core -> move();
+            if (recording)
+                recorder.record(*core);
+            SNAKE_INPUT_CONSUMED();
+        }
+
+        if (alive && pending)
+            pending = !publish();
+
+        lock.lock();
+        if (!alive)
+            break;
+
+        // a snapshot the reader has not taken yet is retried soon after
+        int wait = scheduler.msecsUntilNextStep();
+        if (pending)
+            wait = std::min(wait, retryMsecs);
+        wake.wait_for(lock, std::chrono::milliseconds(wait));
+    }
+
+    // the owner publishes the final state once it sees the runner idle
+    running.store(false, std::memory_order_release);
+}
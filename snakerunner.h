@@ -0,0 +1,101 @@
+#ifndef SNAKERUNNER_H
+#define SNAKERUNNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "autopilot.h"
+#include "boardsnapshot.h"
+#include "mctsplayer.h"
+#include "replay.h"
+#include "snakecore.h"
+#include "stepscheduler.h"
+
+// Plays a running game on its own thread. Between start() and stop() the
+// core belongs to that thread, which steps it on the scheduler's clock and
+// publishes a snapshot after every batch of steps; the GUI only reads the
+// snapshots and feeds directions through SnakeCore::changeDirection, unless
+// the autopilot is on and the runner feeds them itself. The thread ends by
+// itself when the snake dies. Outside of start() and stop() the caller owns
+// the core again and calls publish() after changing it.
+class SnakeRunner {
+
+    const static int retryMsecs;
+
+    SnakeCore *core;
+    StepScheduler scheduler;
+    SnapshotBuffer snapshots;
+
+    std::thread worker;
+    std::atomic<bool> running;
+    bool stopping;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    // the direction queue takes a single producer: while piloting is set
+    // only the runner's thread may call changeDirection
+    Autopilot pilot;
+    bool piloting;
+    std::mutex pilotMutex;
+
+    // the tree search pilot, built on first use since it starts a thread
+    // per core and kept until the runner goes. It thinks for half of every
+    // step without holding pilotMutex; only the runner's thread uses it, and
+    // picks up speed changes from searchBudget
+    std::unique_ptr<MctsPlayer> searcher;
+    bool searching;
+    std::int64_t searchBudget;
+
+    // with setRecording, every step since the core was set and a keyframe
+    // on each start(); recording is what the runner's thread goes by, it
+    // follows wantRecording on start()
+    ReplayRecorder recorder;
+    std::atomic<bool> wantRecording;
+    bool recording;
+
+    void steer();
+    void run();
+
+public:
+
+    SnakeRunner();
+    ~SnakeRunner();
+
+    SnakeRunner(const SnakeRunner&) = delete;
+    SnakeRunner& operator=(const SnakeRunner&) = delete;
+
+    void setCore(SnakeCore *_core);
+    void setSpeed(int stepsPerSecond);
+
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    // once this returns false the caller may feed directions again
+    void setAutopilot(bool on);
+    bool hasAutopilot();
+
+    // which pilot flies: MctsPlayer when on, Autopilot otherwise
+    void setSearch(bool on);
+    bool hasSearch();
+
+    // takes effect on the next start(); turning it off drops the replay
+    void setRecording(bool on);
+    bool isRecording() const;
+
+    // the game since setCore, or since recording was turned on, as a
+    // replay; only while the runner is idle
+    QByteArray toReplay() const;
+
+    // hands the pending changes of the core to the reader, returns false
+    // if the reader has not taken the previous snapshot yet
+    bool publish();
+
+    // the latest snapshot not read yet, or nullptr
+    const BoardSnapshot* acquire();
+};
+
+#endif // SNAKERUNNER_H
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include "autopilot.h"
+#include "batchrunner.h"
+#include "mctsplayer.h"
+#include "snakecore.h"
+
+template <class Core>
+static bool isSafe(const Core &core, Direction dir) {
+    Cell next = core.getHead().next(dir);
+    return core.inBoard(next) && !core.inBarrier(next) && !core.inBody(next);
+}
+
+// Greedy driver: head for the bonus when that is safe, otherwise take any
+// safe turn, otherwise keep going and die.
+template <class Core>
+static Direction chooseDirection(const Core &core) {
+    Cell head = core.getHead(), bonus = core.getBonus();
+    Direction current = core.getDirection();
+
+    Direction wanted[2] = {current, current};
+    if (bonus.x < head.x) wanted[0] = Left;
+    if (bonus.x > head.x) wanted[0] = Right;
+    if (bonus.y < head.y) wanted[1] = Up;
+    if (bonus.y > head.y) wanted[1] = Down;
+
+    for (Direction dir: wanted)
+        if ((static_cast<int>(dir) ^ 1) != static_cast<int>(current) && isSafe(core, dir))
+            return dir;
+
+    for (int i = 0; i < 4; i++) {
+        Direction dir = static_cast<Direction>(i);
+        if ((i ^ 1) != static_cast<int>(current) && isSafe(core, dir))
+            return dir;
+    }
+
+    return current;
+}
+
+template <class Core>
+struct GreedyDriver {
+    Direction next(const Core &core) { return chooseDirection(core); }
+    void forget() { }
+};
+
+template <class Core>
+static BatchSummary play(WorkPool &pool, int width, int height, int games, int maxSteps,
+                         std::uint64_t seed, bool autopilot, std::vector<GameResult> *results) {
+    if (autopilot)
+        return BatchRunner<Core, BasicAutopilot<Core>>(pool, width, height).run(seed, games, maxSteps, results);
+    return BatchRunner<Core, GreedyDriver<Core>>(pool, width, height).run(seed, games, maxSteps, results);
+}
+
+// what the tree search did over all games
+struct SearchTotals {
+    int threads;
+    long long searches, playouts;
+    double seconds;
+};
+
+// The tree search uses every thread on each step, so its games are played
+// one after another on a single core.
+template <class Core>
+static BatchSummary search(int threads, std::int64_t budgetNsecs, int width, int height, int games,
+                           int maxSteps, std::uint64_t seed, std::vector<GameResult> *results,
+                           SearchTotals &totals) {
+    BasicMctsPlayer<Core> player(threads);
+    player.setTimeBudget(budgetNsecs);
+    player.setSeed(seed);
+
+    Core core(width, height, seed);
+    BatchSummary summary;
+    if (results != nullptr)
+        results -> resize(static_cast<size_t>(games));
+
+    for (int game = 0; game < games; game++) {
+        GameResult result = BatchRunner<Core, BasicMctsPlayer<Core>>::play(core, player, seed + game, maxSteps);
+        summary.add(result);
+        if (results != nullptr)
+            (*results)[static_cast<size_t>(game)] = result;
+    }
+
+    totals = SearchTotals {player.threadCount(), player.getSearches(), player.getPlayouts(),
+                           player.getSearchNsecs() / 1e9};
+    return summary;
+}
+
+// the largest board the GUI makes, every thread keeps a game of that size
+static const long long maxCells = 4096ll * 4096;
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("snakesim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Plays snake games headless at full speed and reports throughput.");
+    parser.addHelpOption();
+
+    QCommandLineOption widthOption("width", "Board width.", "cells", "40");
+    QCommandLineOption heightOption("height", "Board height.", "cells", "40");
+    QCommandLineOption gamesOption("games", "Number of games to play.", "count", "100");
+    QCommandLineOption stepsOption("max-steps", "Step limit per game.", "count", "100000");
+    QCommandLineOption seedOption("seed", "Seed of the first game, game i uses seed + i. Random when omitted.", "seed");
+    parser.addOption(widthOption);
+    parser.addOption(heightOption);
+    parser.addOption(gamesOption);
+    parser.addOption(stepsOption);
+    QCommandLineOption autopilotOption("autopilot", "Drive with the built-in autopilot instead of the greedy player.");
+    QCommandLineOption threadsOption("threads", "Worker threads, one per hardware thread when omitted.", "count", "0");
+    QCommandLineOption resultsOption("results", "Write one CSV line per game to this file.", "file");
+    QCommandLineOption searchOption("mcts", "Drive by Monte Carlo tree search, thinking this long per step.", "msecs");
+    parser.addOption(seedOption);
+    parser.addOption(autopilotOption);
+    parser.addOption(threadsOption);
+    parser.addOption(resultsOption);
+    parser.addOption(searchOption);
+    parser.process(app);
+
+    int width = parser.value(widthOption).toInt(),
+        height = parser.value(heightOption).toInt(),
+        games = parser.value(gamesOption).toInt(),
+        maxSteps = parser.value(stepsOption).toInt(),
+        threads = parser.value(threadsOption).toInt(),
+        searchMsecs = parser.value(searchOption).toInt();
+
+    if (width < 5 || height < 5 || games <= 0 || maxSteps <= 0 || threads < 0 || searchMsecs < 0) {
+        std::cerr << "snakesim: board must be at least 5x5, games and max-steps positive, threads and mcts not negative" << std::endl;
+        return 1;
+    }
+    if (!SnakeCore::fits(width, height) || static_cast<long long>(width) * height > maxCells) {
+        std::cerr << "snakesim: board must be at most " << 0x7FFF << " cells a side and " << maxCells
+                  << " cells in all" << std::endl;
+        return 1;
+    }
+
+    QFile resultsFile(parser.value(resultsOption));
+    if (parser.isSet(resultsOption) && !resultsFile.open(QIODevice::WriteOnly)) {
+        std::cerr << "snakesim: can not open " << parser.value(resultsOption).toStdString() << std::endl;
+        return 1;
+    }
+    std::vector<GameResult> results;
+    std::vector<GameResult> *perGame = resultsFile.isOpen() ? &results : nullptr;
+
+    // the search brings its own threads
+    bool searching = parser.isSet(searchOption);
+    WorkPool pool(searching ? 1 : threads);
+    SearchTotals searchTotals = {};
+
+    std::uint64_t seed = parser.isSet(seedOption) ?
+                parser.value(seedOption).toULongLong() : SnakeCore::randomSeed();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the default board has a compile-time specialized core
+    bool autopilot = parser.isSet(autopilotOption);
+    std::int64_t budgetNsecs = searchMsecs * 1000000ll;
+    BatchSummary totals;
+    if (searching)
+        totals = width == 40 && height == 40 ?
+                    search<SnakeCore40x40>(threads, budgetNsecs, width, height, games, maxSteps, seed, perGame, searchTotals) :
+                    search<SnakeCore>(threads, budgetNsecs, width, height, games, maxSteps, seed, perGame, searchTotals);
+    else
+        totals = width == 40 && height == 40 ?
+                    play<SnakeCore40x40>(pool, width, height, games, maxSteps, seed, autopilot, perGame) :
+                    play<SnakeCore>(pool, width, height, games, maxSteps, seed, autopilot, perGame);
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    std::cout << "board      " << width << "x" << height << std::endl;
+    std::cout << "seed       " << seed << std::endl;
+    std::cout << "threads    " << (searching ? searchTotals.threads : pool.size()) << std::endl;
+    std::cout << "games      " << games << std::endl;
+    std::cout << "steps      " << totals.ticks << std::endl;
+    std::cout << "seconds    " << seconds << std::endl;
+    std::cout << "games/s    " << games / seconds << std::endl;
+    std::cout << "steps/s    " << static_cast<long long>(totals.ticks / seconds) << std::endl;
+    std::cout << "mean score " << static_cast<double>(totals.score) / games << std::endl;
+    std::cout << "max score  " << totals.maxScore << std::endl;
+    if (searching) {
+        std::cout << "playouts   " << searchTotals.playouts << std::endl;
+        std::cout << "per step   " << searchTotals.playouts / std::max(searchTotals.searches, 1ll) << std::endl;
+        std::cout << "playouts/s " << static_cast<long long>(searchTotals.playouts / std::max(searchTotals.seconds, 1e-9))
+                  << std::endl;
+    }
+    // how the games ended, one line per cause
+    for (int i = 0; i < GameResult::CauseCount; i++) {
+        std::string label = GameResult::causeName(static_cast<GameResult::Cause>(i));
+        label.resize(11, ' ');
+        std::cout << label << totals.causes[i] << std::endl;
+    }
+
+    if (perGame != nullptr) {
+        std::string csv = "seed,score,length,ticks,cause\n";
+        for (const GameResult &result: results)
+            csv += std::to_string(result.seed) + "," + std::to_string(result.score) + "," +
+                   std::to_string(result.length) + "," + std::to_string(result.ticks) + "," +
+                   GameResult::causeName(result.cause) + "\n";
+        resultsFile.write(csv.data(), static_cast<qint64>(csv.size()));
+    }
+
+    return 0;
+}
@@ -0,0 +1,13 @@
+# Headless simulator: plays games as fast as the CPU allows, no display needed.
+
+TEMPLATE = app
+TARGET = snakesim
+CONFIG += console
+CONFIG -= app_bundle
+QT = core
+
+include(common.pri)
+include(snakecore.pri)
+
+SOURCES += \
+    snakesim.cpp
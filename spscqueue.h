@@ -0,0 +1,54 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+// Bounded single producer single consumer ring. push() is only called from
+// one thread and pop() from one other thread; neither ever blocks or takes
+// a lock, a full queue simply refuses the item. One slot is kept empty to
+// tell a full ring from an empty one.
+template <typename T, int Capacity>
+class SpscQueue {
+
+    T items[Capacity];
+
+    // read and write cursors padded onto their own cache lines, so the two
+    // threads do not keep stealing the same line from each other; padding
+    // rather than alignas keeps owners like SnakeCore fine with plain new
+    char itemsPad[64];
+    std::atomic<int> readPos;
+    char readPad[64 - sizeof(std::atomic<int>)];
+    std::atomic<int> writePos;
+
+public:
+
+    SpscQueue() : readPos {0}, writePos {0} { }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T &item) {
+        int pos = writePos.load(std::memory_order_relaxed),
+            next = pos + 1 == Capacity ? 0 : pos + 1;
+        if (next == readPos.load(std::memory_order_acquire))
+            return false;
+        items[pos] = item;
+        writePos.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        int pos = readPos.load(std::memory_order_relaxed);
+        if (pos == writePos.load(std::memory_order_acquire))
+            return false;
+        item = items[pos];
+        readPos.store(pos + 1 == Capacity ? 0 : pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return readPos.load(std::memory_order_acquire) == writePos.load(std::memory_order_acquire);
+    }
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,71 @@
+#include "stepscheduler.h"
+
+#include <algorithm>
+
+// at most a quarter of a second of missed steps is caught up
+const qint64 StepScheduler::maxCatchUp = 250 * 1000 * 1000;
+
+StepScheduler::StepScheduler() :
+    stepNsecs {100 * 1000 * 1000},
+    lastNsecs {0},
+    accumulator {0},
+    dropped {0},
+    running {false} { };
+
+void StepScheduler::setSpeed(int stepsPerSecond) {
+    stepNsecs = std::max<qint64>(1, 1000 * 1000 * 1000 / std::max(1, stepsPerSecond));
+}
+
+int StepScheduler::getSpeed() const {
+    return static_cast<int>(1000 * 1000 * 1000 / stepNsecs);
+}
+
+qint64 StepScheduler::getStepNsecs() const {
+    return stepNsecs;
+}
+
+void StepScheduler::start() {
+    clock.start();
+    lastNsecs = 0;
+    accumulator = 0;
+    running = true;
+}
+
+void StepScheduler::stop() {
+    running = false;
+}
+
+bool StepScheduler::isRunning() const {
+    return running;
+}
+
+int StepScheduler::due() {
+    if (!running)
+        return 0;
+
+    qint64 now = clock.nsecsElapsed();
+    accumulator += now - lastNsecs;
+    lastNsecs = now;
+
+    qint64 limit = std::max(maxCatchUp, stepNsecs);
+    if (accumulator > limit) {
+        dropped += (accumulator - limit) / stepNsecs;
+        accumulator = limit;
+    }
+
+    qint64 steps = accumulator / stepNsecs;
+    accumulator -= steps * stepNsecs;
+    return static_cast<int>(steps);
+}
+
+int StepScheduler::msecsUntilNextStep() const {
+    if (!running)
+        return 0;
+
+    qint64 left = stepNsecs - accumulator - (clock.nsecsElapsed() - lastNsecs);
+    return left <= 0 ? 0 : static_cast<int>((left + 999999) / 1000000);
+}
+
+long long StepScheduler::getDropped() const {
+    return dropped;
+}
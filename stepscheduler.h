@@ -0,0 +1,39 @@
+#ifndef STEPSCHEDULER_H
+#define STEPSCHEDULER_H
+
+#include <QElapsedTimer>
+
+// Fixed timestep clock for the game loop. Elapsed wall time goes into an
+// accumulator and due() hands it back as whole steps, so the simulation
+// keeps its speed no matter how late the caller wakes up; when the caller
+// falls further behind than maxCatchUp, the backlog is dropped instead of
+// being replayed in one burst.
+class StepScheduler {
+
+    const static qint64 maxCatchUp;
+
+    QElapsedTimer clock;
+    qint64 stepNsecs;
+    qint64 lastNsecs;
+    qint64 accumulator;
+    long long dropped;
+    bool running;
+
+public:
+
+    StepScheduler();
+
+    void setSpeed(int stepsPerSecond);
+    int getSpeed() const;
+    qint64 getStepNsecs() const;
+
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    int due();
+    int msecsUntilNextStep() const;
+    long long getDropped() const;
+};
+
+#endif // STEPSCHEDULER_H
@@ -28,16 +28,25 @@ Coordinate::Coordinate(const QString &str) {
 
 Coordinate::Coordinate(const Coordinate &rhs) : QPoint(rhs.x, rhs.y), x {rhs.x}, y {rhs.y} { };
 
-Coordinate* Coordinate::operator=(const Coordinate &rhs) {
+Coordinate& Coordinate::operator=(const Coordinate &rhs) {
     x = rhs.x;
     y = rhs.y;
-    return this;
+    setX(x);
+    setY(y);
+    return *this;
 }
 
 Coordinate::Coordinate(const QPoint &rhs) :
+    QPoint(rhs),
     x {rhs.x()},
     y {rhs.y()} { };
 
+Coordinate::Coordinate(const Cell &cell) : Coordinate(cell.x, cell.y) { };
+
+Cell Coordinate::toCell() const {
+    return Cell(x, y);
+}
+
 std::string Coordinate::toString() const {
     return "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
 }
@@ -65,6 +74,8 @@ Coordinate Coordinate::operator-(const Coordinate &rhs) const {
 Coordinate Coordinate::operator-=(const Coordinate &rhs) {
     x -= rhs.x;
     y -= rhs.y;
+    setX(x);
+    setY(y);
     return *this;
 }
 
@@ -73,3 +84,29 @@ Direction Coordinate::calcDirection(const Coordinate &rhs) const {
         return static_cast<Direction>(i);
     throw std::runtime_error("bad direction");
 }
+
+Random::Random(std::uint64_t seed) : state {seed} { };
+
+std::uint64_t Random::next() {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+int Random::bounded(int l, int r) {
+    std::uint64_t range = static_cast<std::uint64_t>(r - l);
+    return l + static_cast<int>(((next() >> 32) * range) >> 32);
+}
+
+std::uint64_t Random::getState() const {
+    return state;
+}
+
+void Random::setState(std::uint64_t _state) {
+    state = _state;
+}
+
+std::string Cell::toString() const {
+    return "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
+}
@@ -2,11 +2,46 @@
 #define UTILS_H
 
 #include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
 #include <QPoint>
 #include <QString>
 
 enum Direction {Left = 0, Right, Up, Down};
 
+// A board cell as the core stores it: two 16 bit coordinates in four bytes,
+// trivially copyable, so bodies, barriers and dirty lists are plain arrays
+// the compiler can scan and copy freely. Coordinate below is the Qt facing
+// counterpart; SnakeBoard converts between the two.
+struct Cell {
+    std::int16_t x, y;
+
+    Cell() = default;
+    constexpr Cell(int _x, int _y) : x(static_cast<std::int16_t>(_x)), y(static_cast<std::int16_t>(_y)) { }
+
+    constexpr bool operator==(const Cell &rhs) const { return x == rhs.x && y == rhs.y; }
+    constexpr bool operator!=(const Cell &rhs) const { return !(*this == rhs); }
+
+    constexpr Cell next(Direction dir) const {
+        return Cell(x + (dir == Left ? -1 : dir == Right ? 1 : 0),
+                    y + (dir == Up ? -1 : dir == Down ? 1 : 0));
+    }
+
+    // the direction leading from this cell to the adjacent rhs
+    constexpr Direction calcDirection(const Cell &rhs) const {
+        return rhs == next(Left) ? Left :
+               rhs == next(Right) ? Right :
+               rhs == next(Up) ? Up :
+               rhs == next(Down) ? Down :
+               throw std::runtime_error("bad direction");
+    }
+
+    std::string toString() const;
+};
+
+static_assert(std::is_trivially_copyable<Cell>::value && sizeof(Cell) == 4, "Cell must stay a packed POD");
+
 class Coordinate : public QPoint {
 
     static const int dx[4];
@@ -19,9 +54,10 @@ public:
     Coordinate(int _x, int _y);
     Coordinate(const QPoint &rhs);
     Coordinate(const QString &str);
+    Coordinate(const Cell &cell);
 
     Coordinate(const Coordinate &rhs);
-    Coordinate* operator=(const Coordinate &rhs);
+    Coordinate& operator=(const Coordinate &rhs);
 
     ~Coordinate() = default;
 
@@ -36,6 +72,25 @@ public:
     QString toQString() const;
 
     Direction calcDirection(const Coordinate &rhs) const;
+
+    Cell toCell() const;
+};
+
+// SplitMix64: one 64-bit word of state, so a generator can be saved and
+// restored exactly and every game can own one without any locking.
+class Random {
+
+    std::uint64_t state;
+
+public:
+
+    explicit Random(std::uint64_t seed);
+
+    std::uint64_t next();
+    int bounded(int l, int r); // uniform in [l, r), like QRandomGenerator::bounded
+
+    std::uint64_t getState() const;
+    void setState(std::uint64_t _state);
 };
 
 #endif // UTILS_H
@@ -0,0 +1,126 @@
+#include "workpool.h"
+
+#include <algorithm>
+#include <cassert>
+
+WorkPool::WorkPool(int threadCount) :
+    shares(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())),
+    job {nullptr},
+    generation {0},
+    busy {0},
+    stopping {false} {
+
+    for (auto &share: shares)
+        share.range.store(0, std::memory_order_relaxed);
+
+    for (int worker = 1; worker < size(); worker++)
+        threads.emplace_back(&WorkPool::loop, this, worker);
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &thread: threads)
+        thread.join();
+}
+
+int WorkPool::size() const {
+    return static_cast<int>(shares.size());
+}
+
+std::uint64_t WorkPool::pack(std::uint32_t begin, std::uint32_t end) {
+    return static_cast<std::uint64_t>(end) << 32 | begin;
+}
+
+bool WorkPool::take(int worker, std::int64_t &index) {
+    std::atomic<std::uint64_t> &range = shares[worker].range;
+    std::uint64_t seen = range.load(std::memory_order_acquire);
+    for (;;) {
+        std::uint32_t begin = static_cast<std::uint32_t>(seen), end = static_cast<std::uint32_t>(seen >> 32);
+        if (begin >= end)
+            return false;
+        if (range.compare_exchange_weak(seen, pack(begin + 1, end), std::memory_order_acq_rel)) {
+            index = begin;
+            return true;
+        }
+    }
+}
+
+// Takes the back half of the first non-empty share after our own, keeps its
+// first index and makes the rest our share. Our share is empty here, so no
+// other thread can be changing it.
+bool WorkPool::steal(int worker, std::int64_t &index) {
+    for (int i = 1; i < size(); i++) {
+        std::atomic<std::uint64_t> &range = shares[(worker + i) % size()].range;
+        std::uint64_t seen = range.load(std::memory_order_acquire);
+        for (;;) {
+            std::uint32_t begin = static_cast<std::uint32_t>(seen), end = static_cast<std::uint32_t>(seen >> 32);
+            if (begin >= end)
+                break;
+
+            std::uint32_t middle = begin + (end - begin) / 2;
+            if (!range.compare_exchange_weak(seen, pack(begin, middle), std::memory_order_acq_rel))
+                continue;
+
+            shares[worker].range.store(pack(middle + 1, end), std::memory_order_release);
+            index = middle;
+            return true;
+        }
+    }
+    return false;
+}
+
+// An index is always in exactly one share or being worked on, so once a
+// worker finds every share empty all that is left is in other hands.
+void WorkPool::work(int worker) {
+    std::int64_t index;
+    while (take(worker, index) || steal(worker, index))
+        (*job)(worker, index);
+}
+
+void WorkPool::loop(int worker) {
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+            return;
+        seen = generation;
+
+        lock.unlock();
+        work(worker);
+        lock.lock();
+
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
+
+void WorkPool::run(std::int64_t count, const std::function<void(int, std::int64_t)> &_job) {
+    assert(count >= 0 && count < (static_cast<std::int64_t>(1) << 32));
+    if (count == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &_job;
+        for (int worker = 0; worker < size(); worker++)
+            shares[worker].range.store(pack(static_cast<std::uint32_t>(count * worker / size()),
+                                            static_cast<std::uint32_t>(count * (worker + 1) / size())),
+                                       std::memory_order_relaxed);
+        busy = size() - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busy == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,62 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run index ranges: run(count, job) calls
+// job(worker, i) once for every i in [0, count) and returns when all are
+// done. The calling thread works as worker 0, so a pool of one runs
+// everything inline.
+//
+// Every worker starts with an equal share of the range and takes indices
+// from its front; a worker that runs dry steals the back half of another
+// worker's share. A share is a [begin, end) pair packed into one atomic
+// word, so taking and stealing are a single compare and swap each and no
+// lock is held while the work runs. Jobs must not throw.
+class WorkPool {
+
+    struct Share {
+        std::atomic<std::uint64_t> range;
+        // one share per cache line, workers taking from their own share do
+        // not slow each other down
+        char pad[64 - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<Share> shares;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int, std::int64_t)> *job;
+    std::uint64_t generation;
+    int busy;
+    bool stopping;
+
+    static std::uint64_t pack(std::uint32_t begin, std::uint32_t end);
+    bool take(int worker, std::int64_t &index);
+    bool steal(int worker, std::int64_t &index);
+    void work(int worker);
+    void loop(int worker);
+
+public:
+
+    // 0 threads means one per hardware thread
+    explicit WorkPool(int threadCount = 0);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    int size() const;
+
+    // count is below 2^32; not reentrant, one run at a time
+    void run(std::int64_t count, const std::function<void(int worker, std::int64_t index)> &job);
+};
+
+#endif // WORKPOOL_H